@@ -0,0 +1,28 @@
+#!/bin/sh
+
+# Compares the skip table search for long prefixes with the overlap table
+# search, which --unoptimized keeps, on the generated log. Arguments are
+# passed to search (e.g. --lines 2000 --passes 500).
+
+search="${SEARCH:-`dirname $0`/../build/bench/search}"
+options="$@"
+
+mbps()
+{
+  "${search}" ${options} "$@" | sed -n "s/MB\/sec: //p"
+}
+
+compare()
+{
+  printf "%-28s %10s %10s\n" "$*" `mbps -u "$@"` `mbps "$@"`
+}
+
+printf "%-28s %10s %10s\n" "regexp" "overlap" "skip"
+compare "timeout on /download"
+compare "/api/v1/users 200"
+compare "GET /static/app.js"
+compare "GET /download/corgi-1"
+compare "id=0000[0-9a-f]+"
+compare -i "TIMEOUT ON /DOWNLOAD"
+
+# vim: tabstop=2 shiftwidth=2 expandtab softtabstop=2
@@ -0,0 +1,294 @@
+#include "corgi/config.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include "corgi.h"
+
+typedef CorgiUInt Bool;
+#define TRUE    (42 == 42)
+#define FALSE   !TRUE
+
+struct Options {
+    Bool dfa;
+    Bool ignore_case;
+    Bool linear;
+    CorgiUInt lines;
+    Bool no_capture;
+    CorgiUInt passes;
+    const char* path;
+    Bool unoptimized;
+};
+
+typedef struct Options Options;
+
+static void
+usage()
+{
+    puts("search OPTIONS <regexp>");
+    puts("");
+    puts("OPTIONS:");
+    puts("  --dfa, -D: Search by lazy DFAs");
+    puts("  --file, -f: Read target text from the file (default: generated log)");
+    puts("  --help, -h: Show this message");
+    puts("  --ignore-case, -i: Ignore case");
+    puts("  --linear, -L: Search by the Pike VM");
+    puts("  --lines, -l: Number of lines of generated log (default: 100000)");
+    puts("  --no-capture, -n: Compile groups without capturing");
+    puts("  --passes, -p: Number of passes over the text (default: 10)");
+    puts("  --unoptimized, -u: Compile without optimizations");
+}
+
+static int
+get_char_bytes(const char* s)
+{
+#define RETURN_IF_MATCH(x, v) do { \
+    if ((s[0] & (x)) == (x)) { \
+        return (v); \
+    } \
+} while (0)
+    RETURN_IF_MATCH(0xf0, 4);
+    RETURN_IF_MATCH(0xe0, 3);
+    RETURN_IF_MATCH(0xc0, 2);
+#undef RETURN_IF_MATCH
+    return 1;
+}
+
+static CorgiChar
+conv_utf8_char_to_utf32(const unsigned char* s)
+{
+    switch (get_char_bytes((const char*)s)) {
+    case 1:
+        return s[0];
+    case 2:
+        return ((s[0] & 0x1f) << 6) + (s[1] & 0x3f);
+    case 3:
+        return ((s[0] & 0x0f) << 12) + ((s[1] & 0x3f) << 6) + (s[2] & 0x3f);
+    case 4:
+        return ((s[0] & 0x07) << 18) + ((s[1] & 0x3f) << 12) + ((s[2] & 0x3f) << 6) + (s[3] & 0x3f);
+    default:
+        return '?';
+    }
+}
+
+static CorgiUInt
+conv_utf8_to_utf32(CorgiChar* dest, const char* begin, const char* end)
+{
+    CorgiChar* q = dest;
+    const char* pc;
+    for (pc = begin; pc < end; pc += get_char_bytes(pc)) {
+        *q = conv_utf8_char_to_utf32((const unsigned char*)pc);
+        q++;
+    }
+    return q - dest;
+}
+
+static char*
+read_file(const char* path, size_t* size)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* buf = (char*)malloc(*size + 1);
+    if ((buf == NULL) || (fread(buf, 1, *size, fp) != *size)) {
+        free(buf);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+    buf[*size] = '\0';
+    return buf;
+}
+
+static char*
+generate_log(CorgiUInt lines, size_t* size)
+{
+    static const char* levels[] = { "INFO", "DEBUG", "WARN", "INFO", "DEBUG" };
+    static const char* paths[] = {
+        "/index.html", "/api/v1/users", "/static/app.js", "/login",
+        "/download/corgi-1.0.0.tar.gz" };
+    size_t capacity = 160 * lines + 1;
+    char* buf = (char*)malloc(capacity);
+    if (buf == NULL) {
+        return NULL;
+    }
+    char* p = buf;
+    CorgiUInt seed = 42;
+    CorgiUInt i;
+    for (i = 0; i < lines; i++) {
+        seed = seed * 1103515245 + 12345;
+        CorgiUInt r = (seed >> 16) & 0x7fff;
+        const char* fmt = "2012-10-%02u %02u:%02u:%02u %s GET %s 200 %u ms id=%08x\n";
+        if (r % 1000 == 0) {
+            fmt = "2012-10-%02u %02u:%02u:%02u ERROR: %s timeout on %s after %u ms id=%08x\n";
+        }
+        p += sprintf(p, fmt, r % 28 + 1, r % 24, r % 60, (r / 60) % 60, levels[r % 5], paths[r % 5], r % 500, seed);
+    }
+    *size = p - buf;
+    return buf;
+}
+
+static double
+get_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int
+run(Options* opts, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end)
+{
+    CorgiUInt searches = 0;
+    CorgiUInt matches = 0;
+    double t0 = get_time();
+    CorgiUInt i;
+    for (i = 0; i < opts->passes; i++) {
+        CorgiChar* at = begin;
+        CorgiStatus status = CORGI_OK;
+        while ((at <= end) && (status == CORGI_OK)) {
+            CorgiMatch match;
+            corgi_init_match(&match);
+            status = corgi_search(&match, regexp, begin, end, at, 0);
+            searches++;
+            if (status == CORGI_OK) {
+                matches++;
+                at = begin + (match.begin < match.end ? match.end : match.end + 1);
+            }
+            corgi_fini_match(&match);
+        }
+        if ((status != CORGI_OK) && (status != CORGI_MISMATCH)) {
+            printf("Search failed: %s\n", corgi_strerror(status));
+            return 1;
+        }
+    }
+    double elapsed = get_time() - t0;
+    printf("chars: %td\n", end - begin);
+    printf("matches per pass: %zu\n", matches / opts->passes);
+    printf("searches: %zu in %.3f sec\n", searches, elapsed);
+    printf("searches/sec: %.1f\n", searches / elapsed);
+    printf("MB/sec: %.1f\n", (double)(end - begin) * opts->passes / elapsed / (1024 * 1024));
+    return 0;
+}
+
+static int
+bench_main(Options* opts, const char* s)
+{
+    size_t size;
+    char* text = opts->path != NULL ? read_file(opts->path, &size) : generate_log(opts->lines, &size);
+    if (text == NULL) {
+        puts("Cannot prepare the target text");
+        return 1;
+    }
+    CorgiChar* target = (CorgiChar*)malloc(sizeof(CorgiChar) * (size + 1));
+    CorgiChar* re = (CorgiChar*)malloc(sizeof(CorgiChar) * (strlen(s) + 1));
+    if ((target == NULL) || (re == NULL)) {
+        free(re);
+        free(target);
+        free(text);
+        return 1;
+    }
+    CorgiUInt target_size = conv_utf8_to_utf32(target, text, text + size);
+    CorgiUInt re_size = conv_utf8_to_utf32(re, s, s + strlen(s));
+    free(text);
+
+    CorgiRegexp regexp;
+    corgi_init_regexp(&regexp);
+    CorgiOptions corgi_opts = opts->ignore_case ? CORGI_OPT_IGNORE_CASE : 0;
+    if (opts->no_capture) {
+        corgi_opts |= CORGI_OPT_NO_CAPTURE;
+    }
+    if (opts->unoptimized) {
+        corgi_opts |= CORGI_OPT_NO_OPTIMIZE;
+    }
+    if (opts->dfa) {
+        corgi_opts |= CORGI_OPT_DFA;
+    }
+    if (opts->linear) {
+        corgi_opts |= CORGI_OPT_LINEAR;
+    }
+    CorgiStatus status = corgi_compile(&regexp, re, re + re_size, corgi_opts);
+    int ret = 1;
+    if (status == CORGI_OK) {
+        ret = run(opts, &regexp, target, target + target_size);
+    }
+    else {
+        printf("Compile failed: %s\n", corgi_strerror(status));
+    }
+    corgi_fini_regexp(&regexp);
+    free(re);
+    free(target);
+    return ret;
+}
+
+int
+main(int argc, char* argv[])
+{
+    struct option longopts[] = {
+        { "dfa", no_argument, NULL, 'D' },
+        { "file", required_argument, NULL, 'f' },
+        { "help", no_argument, NULL, 'h' },
+        { "ignore-case", no_argument, NULL, 'i' },
+        { "linear", no_argument, NULL, 'L' },
+        { "lines", required_argument, NULL, 'l' },
+        { "no-capture", no_argument, NULL, 'n' },
+        { "passes", required_argument, NULL, 'p' },
+        { "unoptimized", no_argument, NULL, 'u' },
+        { 0, 0, 0, 0 },
+    };
+    Options opts;
+    bzero(&opts, sizeof(Options));
+    opts.lines = 100000;
+    opts.passes = 10;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "DLf:hil:np:u", longopts, NULL)) != -1) {
+        switch (opt) {
+        case 'D':
+            opts.dfa = TRUE;
+            break;
+        case 'L':
+            opts.linear = TRUE;
+            break;
+        case 'f':
+            opts.path = optarg;
+            break;
+        case 'h':
+            usage();
+            return 0;
+        case 'i':
+            opts.ignore_case = TRUE;
+            break;
+        case 'l':
+            opts.lines = atoi(optarg);
+            break;
+        case 'n':
+            opts.no_capture = TRUE;
+            break;
+        case 'p':
+            opts.passes = atoi(optarg);
+            break;
+        case 'u':
+            opts.unoptimized = TRUE;
+            break;
+        case '?':
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if ((argc - optind < 1) || (opts.passes == 0)) {
+        usage();
+        return 1;
+    }
+    return bench_main(&opts, argv[optind]);
+}
+
+/**
+ * vim: tabstop=4 shiftwidth=4 expandtab softtabstop=4
+ */
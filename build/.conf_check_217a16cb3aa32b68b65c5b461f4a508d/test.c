@@ -0,0 +1,5 @@
+#include <alloc.h>
+
+int main() {
+	return 0;
+}
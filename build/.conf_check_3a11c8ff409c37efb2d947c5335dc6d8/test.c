@@ -0,0 +1,7 @@
+#include <stdio.h>
+int
+main(int argc, const char* argv[])
+{
+    printf("%zu", sizeof(long));
+    return 0;
+}
@@ -0,0 +1,13 @@
+/* WARNING! All changes made to this file will be lost! */
+
+#ifndef _INCLUDE_CORGI_CONFIG_H_WAF
+#define _INCLUDE_CORGI_CONFIG_H_WAF
+
+/* #undef CORGI_ALLOC_H */
+#define CORGI_SIZEOF_INT 4
+#define CORGI_SIZEOF_LONG 8
+#define CORGI_SIZEOF_LONG_LONG 8
+#define CORGI_SIZEOF_VOIDP 8
+#define CORGI_PACKAGE_VERSION "1.0.0dev1"
+
+#endif /* _INCLUDE_CORGI_CONFIG_H_WAF */
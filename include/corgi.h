@@ -39,10 +39,43 @@ struct CorgiRegexp {
     CorgiUInt code_size;
     CorgiUInt groups_num;
     struct CorgiGroup** groups;
+    CorgiUInt min_width;
+    CorgiUInt max_width;
+    CorgiUInt anchor;
+    /* a literal which every match contains. a match starts from
+       required_min to required_max characters before it */
+    CorgiChar* required;
+    CorgiUInt required_size;
+    CorgiUInt required_min;
+    CorgiUInt required_max;
+    /* a program which matches reversed strings from the end of a match, for
+       a pattern ending with $ or \Z */
+    CorgiUInt end_anchor;
+    CorgiCode* reverse_code;
+    CorgiUInt reverse_code_size;
+    CorgiUInt single_line;  /* no match contains a linebreak */
+    /* lazy DFAs for CORGI_OPT_DFA. they grow while searching */
+    struct CorgiDfa* dfa;
+    struct CorgiProg* prog; /* a program of the Pike VM for CORGI_OPT_LINEAR */
+    /* a program which corgi_match() runs in one scan when at most one thread
+       can take each character */
+    struct CorgiOnePass* onepass;
+    struct CorgiShiftAnd* shift_and; /* a bit-parallel automaton for searches */
+    /* a program which is backtracked with a bitmap of tried positions, for
+       short strings */
+    struct CorgiProg* bitstate;
 };
 
 typedef struct CorgiRegexp CorgiRegexp;
 
+/* max_width of a regexp which can match a string of any length */
+#define CORGI_WIDTH_UNBOUNDED   ((CorgiUInt)-1)
+
+/* where every match of a regexp must start. a stronger anchor is larger */
+#define CORGI_ANCHOR_NONE       0
+#define CORGI_ANCHOR_LINE       1   /* ^ */
+#define CORGI_ANCHOR_STRING     2   /* \A */
+
 typedef struct CorgiRange CorgiRange;
 
 struct CorgiMatch {
@@ -54,21 +87,51 @@ struct CorgiMatch {
 
 typedef struct CorgiMatch CorgiMatch;
 
+/* patterns which corgi_search_set() searches at once */
+struct CorgiSet {
+    struct CorgiRegexp* regexps;    /* in the order of the patterns */
+    CorgiUInt regexps_num;
+    /* a lazy DFA of all patterns which a program can run. the others are
+       searched one by one */
+    struct CorgiSetDfa* dfa;
+    CorgiUInt* others;
+    CorgiUInt others_num;
+};
+
+typedef struct CorgiSet CorgiSet;
+
 typedef CorgiUInt CorgiOptions;
 #define CORGI_OPT_DEBUG         (1 << 0)
 #define CORGI_OPT_IGNORE_CASE   (1 << 1)
+/* compile all groups as (?:...). a match has no groups */
+#define CORGI_OPT_NO_CAPTURE    (1 << 2)
+/* compile without normalizing the syntax tree and optimizing VM codes */
+#define CORGI_OPT_NO_OPTIMIZE   (1 << 3)
+/* run a pattern by lazy DFAs instead of the VM. groups are found in a match
+   of the DFAs by matching once more. the VM still runs a pattern with atomic
+   groups or possessive repeats. a regexp must not be searched by threads at
+   once */
+#define CORGI_OPT_DFA           (1 << 4)
+/* run a pattern by the Pike VM, which takes time linear to the string, with
+   groups. the backtracking VM still runs a pattern with atomic groups or
+   possessive repeats. with CORGI_OPT_DFA, the Pike VM finds only groups */
+#define CORGI_OPT_LINEAR        (1 << 5)
 
 CorgiStatus corgi_compile(CorgiRegexp*, CorgiChar*, CorgiChar*, CorgiOptions);
+CorgiStatus corgi_compile_set(CorgiSet*, CorgiChar**, CorgiChar**, CorgiUInt, CorgiOptions);
 CorgiStatus corgi_disassemble(CorgiRegexp*);
 CorgiStatus corgi_dump(CorgiChar*, CorgiChar*, CorgiOptions);
 CorgiStatus corgi_fini_match(CorgiMatch*);
 CorgiStatus corgi_fini_regexp(CorgiRegexp*);
+CorgiStatus corgi_fini_set(CorgiSet*);
 CorgiStatus corgi_get_group_range(CorgiMatch*, CorgiUInt, CorgiInt*, CorgiInt*);
 CorgiStatus corgi_group_name2id(CorgiRegexp*, CorgiChar*, CorgiChar*, CorgiUInt*);
 CorgiStatus corgi_init_match(CorgiMatch*);
 CorgiStatus corgi_init_regexp(CorgiRegexp*);
+CorgiStatus corgi_init_set(CorgiSet*);
 CorgiStatus corgi_match(CorgiMatch*, CorgiRegexp*, CorgiChar*, CorgiChar*, CorgiChar*, CorgiOptions);
 CorgiStatus corgi_search(CorgiMatch*, CorgiRegexp*, CorgiChar*, CorgiChar*, CorgiChar*, CorgiOptions);
+CorgiStatus corgi_search_set(CorgiSet*, CorgiChar*, CorgiChar*, CorgiChar*, CorgiUInt*, CorgiUInt*, CorgiOptions);
 const char* corgi_strerror(CorgiStatus);
 
 #endif
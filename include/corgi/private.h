@@ -15,6 +15,14 @@ Bool corgi_is_numeric(CorgiChar);
 Bool corgi_is_space(CorgiChar);
 CorgiChar corgi_tolower(CorgiChar);
 
+/* the table of an ASCII set has 16 bytes. the byte of the low nibble of a
+   character has the bit of the high nibble when the set has it */
+CorgiChar* corgi_find_ascii(CorgiChar*, CorgiChar*, const unsigned char*);
+CorgiChar* corgi_find_char(CorgiChar*, CorgiChar*, CorgiChar);
+CorgiChar* corgi_find_chars(CorgiChar*, CorgiChar*, CorgiChar*, CorgiUInt);
+CorgiChar* corgi_skip_ascii(CorgiChar*, CorgiChar*, const unsigned char*);
+CorgiChar* corgi_skip_char(CorgiChar*, CorgiChar*, CorgiChar);
+
 #endif
 /**
  * vim: tabstop=4 shiftwidth=4 expandtab softtabstop=4
@@ -57,6 +57,7 @@
 #define ERR_BOGUS_ESCAPE            5
 #define ERR_PARENTHESIS_NOT_CLOSED  6
 #define ERR_NO_SUCH_GROUP           7
+#define ERR_INVALID_STATE           8
 
 struct CorgiGroup {
     CorgiChar* begin;
@@ -90,6 +91,8 @@ corgi_strerror(CorgiStatus status)
         return "Parenthesis not properly closed";
     case ERR_NO_SUCH_GROUP:
         return "No such group";
+    case ERR_INVALID_STATE:
+        return "Invalid state of the VM";
     default:
         return "Unknown error";
     }
@@ -120,11 +123,25 @@ static char sre_char_info[128] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 6, 2,
     ((ch) < 128 ? (sre_char_info[(ch)] & SRE_SPACE_MASK) : 0)
 #define SRE_IS_LINEBREAK(ch)\
     ((ch) < 128 ? (sre_char_info[(ch)] & SRE_LINEBREAK_MASK) : 0)
+/* '\n' is the only linebreak */
+#define SRE_FIND_LINEBREAK(ptr, end) corgi_find_char((ptr), (end), '\n')
 #define SRE_IS_ALNUM(ch)\
     ((ch) < 128 ? (sre_char_info[(ch)] & SRE_ALNUM_MASK) : 0)
 #define SRE_IS_WORD(ch)\
     ((ch) < 128 ? (sre_char_info[(ch)] & SRE_WORD_MASK) : 0)
 
+/* ASCII letters are folded without looking up the unicode database */
+#define SRE_LOWER(ch)\
+    ((ch) < 128 ? (('A' <= (ch)) && ((ch) <= 'Z') ? (ch) + 32 : (ch)) : corgi_tolower((ch)))
+
+/* the first character of LITERAL_STRING is placed after its length */
+#define SRE_IS_LITERAL_OP(op)\
+    (((op) == SRE_OP_LITERAL) || ((op) == SRE_OP_LITERAL_STRING))
+#define SRE_IS_LITERAL_IGNORE_OP(op)\
+    (((op) == SRE_OP_LITERAL_IGNORE) || ((op) == SRE_OP_LITERAL_STRING_IGNORE))
+#define SRE_FIRST_LITERAL(pattern)\
+    ((pattern)[((pattern)[0] == SRE_OP_LITERAL) || ((pattern)[0] == SRE_OP_LITERAL_IGNORE) ? 1 : 2])
+
 #define SRE_UNI_IS_DIGIT(c)     corgi_is_digit((c))
 #define SRE_UNI_IS_SPACE(c)     corgi_is_space((c))
 #define SRE_UNI_IS_LINEBREAK(c) corgi_is_linebreak((c))
@@ -187,6 +204,14 @@ sre_category(CorgiCode category, CorgiChar ch)
 /* FIXME: <fl> shouldn't be a constant, really... */
 #define SRE_MARK_SIZE 200
 
+/* a skip table of a prefix is keyed on the low bits of characters */
+#define SRE_SKIP_TABLE_SIZE 256
+#define SRE_SKIP_INDEX(ch) ((ch) & (SRE_SKIP_TABLE_SIZE - 1))
+/* ASCII_BITMAP has a nibble table of 16 bytes (see corgi/private.h) */
+#define SRE_ASCII_BITMAP_WORDS (16 / sizeof(CorgiCode))
+#define SRE_ASCII_BITMAP_TABLE(set) ((const unsigned char*)((set) + 1))
+#define SRE_IS_IN_ASCII_BITMAP(table, ch) (((table)[(ch) & 15] >> ((ch) >> 4)) & 1)
+
 struct Repeat {
     CorgiInt count;
     CorgiCode* pattern; /* points to REPEAT operator arguments */
@@ -212,6 +237,7 @@ struct State {
     size_t data_stack_base;
     /* current repeat context */
     Repeat *repeat;
+    CorgiRegexp* regexp;
     Bool debug;
 };
 
@@ -326,6 +352,13 @@ sre_charset(CorgiCode* set, CorgiCode ch)
         switch (op) {
         case SRE_OP_FAILURE:
             return !ok;
+        case SRE_OP_ASCII_BITMAP:
+            /* <ASCII_BITMAP> <nibble table> (the whole set for ASCII) */
+            if (ch < 128) {
+                return SRE_IS_IN_ASCII_BITMAP(SRE_ASCII_BITMAP_TABLE(set - 1), ch);
+            }
+            set += SRE_ASCII_BITMAP_WORDS;
+            break;
         case SRE_OP_LITERAL:
             /* <LITERAL> <code> */
             if (ch == set[0]) {
@@ -342,7 +375,7 @@ sre_charset(CorgiCode* set, CorgiCode ch)
             break;
         case SRE_OP_CHARSET:
             /* <CHARSET> <bitmap> (32 bits per code word) */
-            if ((ch < 256) && (set[ch >> 5] & (1 << (ch & 31)))) {
+            if ((ch < 256) && (set[ch >> 5] & ((CorgiCode)1 << (ch & 31)))) {
                 return ok;
             }
             set += 8;
@@ -365,7 +398,7 @@ sre_charset(CorgiCode* set, CorgiCode ch)
                  * warnings when c's type supports only numbers < N+1 */
                 CorgiInt block = !(ch & ~65535) ? ((unsigned char*)set)[ch >> 8] : -1;
                 set += 64;
-                if ((0 <= block) && (set[block * 8 + ((ch & 255) >> 5)] & (1 << (ch & 31)))) {
+                if ((0 <= block) && (set[block * 8 + ((ch & 255) >> 5)] & ((CorgiCode)1 << (ch & 31)))) {
                     return ok;
                 }
                 set += count * 8;
@@ -401,16 +434,37 @@ sre_count(State* state, CorgiCode* pattern, CorgiInt maxcount)
     case SRE_OP_IN:
         /* repeated set */
         TRACE(("|%p|%p|COUNT IN\n", pattern, ptr));
+        if (pattern[2] == SRE_OP_ASCII_BITMAP) {
+            /* the kernel stops at a non-ASCII character too */
+            ptr = corgi_skip_ascii(ptr, end, SRE_ASCII_BITMAP_TABLE(pattern + 2));
+            while ((ptr < end) && sre_charset(pattern + 2, *ptr)) {
+                ptr = corgi_skip_ascii(ptr + 1, end, SRE_ASCII_BITMAP_TABLE(pattern + 2));
+            }
+            break;
+        }
         while ((ptr < end) && sre_charset(pattern + 2, *ptr)) {
             ptr++;
         }
         break;
+    case SRE_OP_IN_IGNORE:
+        /* repeated set (the set is closed under case folding) */
+        TRACE(("|%p|%p|COUNT IN_IGNORE\n", pattern, ptr));
+        if (pattern[2] == SRE_OP_ASCII_BITMAP) {
+            /* the nibble table has the upper case ASCII letters too */
+            ptr = corgi_skip_ascii(ptr, end, SRE_ASCII_BITMAP_TABLE(pattern + 2));
+            while ((ptr < end) && sre_charset(pattern + 2, SRE_LOWER(*ptr))) {
+                ptr = corgi_skip_ascii(ptr + 1, end, SRE_ASCII_BITMAP_TABLE(pattern + 2));
+            }
+            break;
+        }
+        while ((ptr < end) && sre_charset(pattern + 2, SRE_LOWER(*ptr))) {
+            ptr++;
+        }
+        break;
     case SRE_OP_ANY:
         /* repeated dot wildcard. */
         TRACE(("|%p|%p|COUNT ANY\n", pattern, ptr));
-        while ((ptr < end) && !SRE_IS_LINEBREAK(*ptr)) {
-            ptr++;
-        }
+        ptr = SRE_FIND_LINEBREAK(ptr, end);
         break;
     case SRE_OP_ANY_ALL:
         /* repeated dot wildcard.  skip to the end of the target
@@ -422,15 +476,16 @@ sre_count(State* state, CorgiCode* pattern, CorgiInt maxcount)
         /* repeated literal */
         chr = pattern[1];
         TRACE(("|%p|%p|COUNT LITERAL %d (%c)\n", pattern, ptr, chr, isprint(chr) ? chr : ' '));
-        while ((ptr < end) && (*ptr == chr)) {
-            ptr++;
+        /* most runs are short. the kernel is for long ones */
+        if ((ptr < end) && (*ptr == chr)) {
+            ptr = corgi_skip_char(ptr + 1, end, chr);
         }
         break;
     case SRE_OP_LITERAL_IGNORE:
         /* repeated literal */
         chr = pattern[1];
         TRACE(("|%p|%p|COUNT LITERAL_IGNORE %d\n", pattern, ptr, chr));
-        while ((ptr < end) && (corgi_tolower(*ptr) == chr)) {
+        while ((ptr < end) && (SRE_LOWER(*ptr) == chr)) {
             ptr++;
         }
         break;
@@ -438,15 +493,20 @@ sre_count(State* state, CorgiCode* pattern, CorgiInt maxcount)
         /* repeated non-literal */
         chr = pattern[1];
         TRACE(("|%p|%p|COUNT NOT_LITERAL %d\n", pattern, ptr, chr));
-        while ((ptr < end) && (*ptr != chr)) {
-            ptr++;
-        }
+        ptr = corgi_find_char(ptr, end, chr);
         break;
     case SRE_OP_NOT_LITERAL_IGNORE:
         /* repeated non-literal */
         chr = pattern[1];
         TRACE(("|%p|%p|COUNT NOT_LITERAL_IGNORE %d\n", pattern, ptr, chr));
-        while ((ptr < end) && (corgi_tolower(*ptr) != chr)) {
+        while ((ptr < end) && (SRE_LOWER(*ptr) != chr)) {
+            ptr++;
+        }
+        break;
+    case SRE_OP_CATEGORY:
+        /* repeated category like \d */
+        TRACE(("|%p|%p|COUNT CATEGORY %d\n", pattern, ptr, pattern[1]));
+        while ((ptr < end) && sre_category(pattern[1], *ptr)) {
             ptr++;
         }
         break;
@@ -624,6 +684,9 @@ sre_count(State* state, CorgiCode* pattern, CorgiInt maxcount)
 #define JUMP_BRANCH         11
 #define JUMP_ASSERT         12
 #define JUMP_ASSERT_NOT     13
+#define JUMP_ATOMIC_GROUP   14
+#define JUMP_POSSESSIVE_REPEAT_1    15
+#define JUMP_POSSESSIVE_REPEAT_2    16
 
 #define DO_JUMP(jumpvalue, jumplabel, nextpattern) \
     DATA_ALLOC(sre_match_context, nextctx); \
@@ -716,6 +779,35 @@ entrance:
             ctx->pattern++;
             ctx->ptr++;
             break;
+        case SRE_OP_LITERAL_STRING:
+            /* match run of literal characters */
+            /* <LITERAL_STRING> <length> <codes> */
+            TRACE(("|%p|%p|LITERAL_STRING %d\n", ctx->pattern, ctx->ptr, *ctx->pattern));
+            if (end - ctx->ptr < ctx->pattern[0]) {
+                RETURN_FAILURE;
+            }
+            for (i = 0; i < (CorgiInt)ctx->pattern[0]; i++) {
+                if (ctx->ptr[i] != ctx->pattern[i + 1]) {
+                    RETURN_FAILURE;
+                }
+            }
+            ctx->ptr += ctx->pattern[0];
+            ctx->pattern += ctx->pattern[0] + 1;
+            break;
+        case SRE_OP_LITERAL_STRING_IGNORE:
+            /* <LITERAL_STRING_IGNORE> <length> <codes in lower case> */
+            TRACE(("|%p|%p|LITERAL_STRING_IGNORE %d\n", ctx->pattern, ctx->ptr, *ctx->pattern));
+            if (end - ctx->ptr < ctx->pattern[0]) {
+                RETURN_FAILURE;
+            }
+            for (i = 0; i < (CorgiInt)ctx->pattern[0]; i++) {
+                if (SRE_LOWER(ctx->ptr[i]) != ctx->pattern[i + 1]) {
+                    RETURN_FAILURE;
+                }
+            }
+            ctx->ptr += ctx->pattern[0];
+            ctx->pattern += ctx->pattern[0] + 1;
+            break;
         case SRE_OP_NOT_LITERAL:
             /* match anything that is not literal character */
             /* <NOT_LITERAL> <code> */
@@ -780,7 +872,7 @@ entrance:
             break;
         case SRE_OP_LITERAL_IGNORE:
             TRACE(("|%p|%p|LITERAL_IGNORE %d\n", ctx->pattern, ctx->ptr, ctx->pattern[0]));
-            if ((end <= ctx->ptr) || (corgi_tolower(*ctx->ptr) != corgi_tolower(*ctx->pattern))) {
+            if ((end <= ctx->ptr) || (SRE_LOWER(*ctx->ptr) != *ctx->pattern)) {
                 RETURN_FAILURE;
             }
             ctx->pattern++;
@@ -788,7 +880,7 @@ entrance:
             break;
         case SRE_OP_NOT_LITERAL_IGNORE:
             TRACE(("|%p|%p|NOT_LITERAL_IGNORE %d\n", ctx->pattern, ctx->ptr, *ctx->pattern));
-            if ((end <= ctx->ptr) || (corgi_tolower(*ctx->ptr) == corgi_tolower(*ctx->pattern))) {
+            if ((end <= ctx->ptr) || (SRE_LOWER(*ctx->ptr) == *ctx->pattern)) {
                 RETURN_FAILURE;
             }
             ctx->pattern++;
@@ -796,7 +888,7 @@ entrance:
             break;
         case SRE_OP_IN_IGNORE:
             TRACE(("|%p|%p|IN_IGNORE\n", ctx->pattern, ctx->ptr));
-            if ((end <= ctx->ptr) || !sre_charset(ctx->pattern + 1, corgi_tolower(*ctx->ptr))) {
+            if ((end <= ctx->ptr) || !sre_charset(ctx->pattern + 1, SRE_LOWER(*ctx->ptr))) {
                 RETURN_FAILURE;
             }
             ctx->pattern += ctx->pattern[0];
@@ -819,12 +911,18 @@ entrance:
                 MARK_PUSH(ctx->lastmark);
             }
             for (; ctx->pattern[0]; ctx->pattern += ctx->pattern[0]) {
-                if ((ctx->pattern[1] == SRE_OP_LITERAL) && ((end <= ctx->ptr) || (*ctx->ptr != ctx->pattern[2]))) {
+                if (SRE_IS_LITERAL_OP(ctx->pattern[1]) && ((end <= ctx->ptr) || (*ctx->ptr != SRE_FIRST_LITERAL(ctx->pattern + 1)))) {
                     continue;
                 }
                 if ((ctx->pattern[1] == SRE_OP_IN) && ((end <= ctx->ptr) || !sre_charset(ctx->pattern + 3, *ctx->ptr))) {
                     continue;
                 }
+                if (SRE_IS_LITERAL_IGNORE_OP(ctx->pattern[1]) && ((end <= ctx->ptr) || (SRE_LOWER(*ctx->ptr) != SRE_FIRST_LITERAL(ctx->pattern + 1)))) {
+                    continue;
+                }
+                if ((ctx->pattern[1] == SRE_OP_IN_IGNORE) && ((end <= ctx->ptr) || !sre_charset(ctx->pattern + 3, SRE_LOWER(*ctx->ptr)))) {
+                    continue;
+                }
                 state->ptr = ctx->ptr;
                 DO_JUMP(JUMP_BRANCH, jump_branch, ctx->pattern + 1);
                 if (ret) {
@@ -880,12 +978,12 @@ entrance:
 
             LASTMARK_SAVE();
 
-            if (ctx->pattern[ctx->pattern[0]] == SRE_OP_LITERAL) {
+            if (SRE_IS_LITERAL_OP(ctx->pattern[ctx->pattern[0]]) || SRE_IS_LITERAL_IGNORE_OP(ctx->pattern[ctx->pattern[0]])) {
                 /* tail starts with a literal. skip positions where
                    the rest of the pattern cannot possibly match */
-                ctx->u.chr = ctx->pattern[ctx->pattern[0] + 1];
+                ctx->u.chr = SRE_FIRST_LITERAL(ctx->pattern + ctx->pattern[0]);
                 for (;;) {
-                    while (((CorgiInt)ctx->pattern[1] <= ctx->count) && ((end <= ctx->ptr) || (*ctx->ptr != ctx->u.chr))) {
+                    while (((CorgiInt)ctx->pattern[1] <= ctx->count) && ((end <= ctx->ptr) || ((SRE_IS_LITERAL_OP(ctx->pattern[ctx->pattern[0]]) ? *ctx->ptr : SRE_LOWER(*ctx->ptr)) != ctx->u.chr))) {
                         ctx->ptr--;
                         ctx->count--;
                     }
@@ -978,6 +1076,91 @@ entrance:
                 }
             }
             RETURN_FAILURE;
+        case SRE_OP_POSSESSIVE_REPEAT_ONE:
+            /* match repeated sequence (possessive regexp). this is
+               REPEAT_ONE which never gives back any character */
+            /* <POSSESSIVE_REPEAT_ONE> <skip> <1=min> <2=max> item <SUCCESS> tail */
+            TRACE(("|%p|%p|POSSESSIVE_REPEAT_ONE %d %d\n", ctx->pattern, ctx->ptr, ctx->pattern[1], ctx->pattern[2]));
+            if (end < ctx->ptr + ctx->pattern[1]) {
+                RETURN_FAILURE; /* cannot match */
+            }
+
+            state->ptr = ctx->ptr;
+
+            ret = sre_count(state, ctx->pattern + 3, ctx->pattern[2]);
+            RETURN_ON_ERROR(ret);
+            DATA_LOOKUP_AT(sre_match_context, ctx, ctx_pos);
+            ctx->count = ret;
+            ctx->ptr += ctx->count;
+
+            if (ctx->count < (CorgiInt)ctx->pattern[1]) {
+                RETURN_FAILURE;
+            }
+
+            /* continue with the tail. no backtracking point is left */
+            ctx->pattern += ctx->pattern[0];
+            break;
+        case SRE_OP_POSSESSIVE_REPEAT:
+            /* match repeated sequence (possessive regexp). each
+               iteration is atomic, and the tail never backtracks into
+               the repeat */
+            /* <POSSESSIVE_REPEAT> <skip> <1=min> <2=max> item <SUCCESS> tail */
+            TRACE(("|%p|%p|POSSESSIVE_REPEAT %d %d\n", ctx->pattern, ctx->ptr, ctx->pattern[1], ctx->pattern[2]));
+
+            /* BRANCH in the item saves marks only in a repeat context */
+            ctx->u.rep = (Repeat*)malloc(sizeof(*ctx->u.rep));
+            if (ctx->u.rep == NULL) {
+                RETURN_FAILURE;
+            }
+            ctx->u.rep->count = -1;
+            ctx->u.rep->pattern = NULL;
+            ctx->u.rep->prev = state->repeat;
+            ctx->u.rep->last_ptr = NULL;
+            state->repeat = ctx->u.rep;
+
+            state->ptr = ctx->ptr;
+            ctx->count = 0;
+            while (ctx->count < (CorgiInt)ctx->pattern[1]) {
+                /* not enough matches */
+                DO_JUMP(JUMP_POSSESSIVE_REPEAT_1, jump_possessive_repeat_1, ctx->pattern + 3);
+                if (ret <= 0) {
+                    state->repeat = ctx->u.rep->prev;
+                    free(ctx->u.rep);
+                    RETURN_ON_ERROR(ret);
+                    RETURN_FAILURE;
+                }
+                ctx->count++;
+            }
+
+            /* ctx->ptr keeps the end of the last iteration. an empty
+               iteration stops the loop, because all of the following
+               iterations are empty too */
+            ctx->ptr = NULL;
+            while ((((CorgiInt)ctx->pattern[2] == 65535) || (ctx->count < (CorgiInt)ctx->pattern[2])) && (state->ptr != ctx->ptr)) {
+                LASTMARK_SAVE();
+                MARK_PUSH(ctx->lastmark);
+                ctx->ptr = state->ptr;
+                DO_JUMP(JUMP_POSSESSIVE_REPEAT_2, jump_possessive_repeat_2, ctx->pattern + 3);
+                if (ret <= 0) {
+                    MARK_POP(ctx->lastmark);
+                    LASTMARK_RESTORE();
+                    if (ret < 0) {
+                        state->repeat = ctx->u.rep->prev;
+                        free(ctx->u.rep);
+                        RETURN_ERROR(ret);
+                    }
+                    state->ptr = ctx->ptr;
+                    break;
+                }
+                MARK_POP_DISCARD(ctx->lastmark);
+                ctx->count++;
+            }
+            state->repeat = ctx->u.rep->prev;
+            free(ctx->u.rep);
+
+            ctx->ptr = state->ptr;
+            ctx->pattern += ctx->pattern[0];
+            break;
         case SRE_OP_REPEAT:
             /* create repeat context.  all the hard work is done
                by the UNTIL operator (MAX_UNTIL, MIN_UNTIL) */
@@ -1106,12 +1289,16 @@ entrance:
 
             LASTMARK_RESTORE();
 
-            if ((ctx->u.rep->pattern[2] <= ctx->count) && (ctx->u.rep->pattern[2] != 65535)) {
+            if (((ctx->u.rep->pattern[2] <= ctx->count) && (ctx->u.rep->pattern[2] != 65535)) || (state->ptr == ctx->u.rep->last_ptr)) {
                 RETURN_FAILURE;
             }
 
             ctx->u.rep->count = ctx->count;
+            /* zero-width match protection like MAX_UNTIL */
+            DATA_PUSH(&ctx->u.rep->last_ptr);
+            ctx->u.rep->last_ptr = state->ptr;
             DO_JUMP(JUMP_MIN_UNTIL_3, jump_min_until_3, ctx->u.rep->pattern + 3);
+            DATA_POP(&ctx->u.rep->last_ptr);
             if (ret) {
                 RETURN_ON_ERROR(ret);
                 RETURN_SUCCESS;
@@ -1189,6 +1376,17 @@ entrance:
             }
             ctx->pattern += 2;
             break;
+        case SRE_OP_ATOMIC_GROUP:
+            /* match subpattern once, and discard its backtracking
+               points */
+            /* <ATOMIC_GROUP> <skip> pattern <SUCCESS> tail */
+            TRACE(("|%p|%p|ATOMIC_GROUP\n", ctx->pattern, ctx->ptr));
+            state->ptr = ctx->ptr;
+            DO_JUMP(JUMP_ATOMIC_GROUP, jump_atomic_group, ctx->pattern + 1);
+            RETURN_ON_FAILURE(ret);
+            ctx->ptr = state->ptr;
+            ctx->pattern += ctx->pattern[0];
+            break;
         case SRE_OP_ASSERT:
             /* assert subpattern */
             /* <ASSERT> <skip> <back> <pattern> */
@@ -1274,6 +1472,15 @@ exit:
     case JUMP_ASSERT_NOT:
         TRACE(("|%p|%p|JUMP_ASSERT_NOT\n", ctx->pattern, ctx->ptr));
         goto jump_assert_not;
+    case JUMP_ATOMIC_GROUP:
+        TRACE(("|%p|%p|JUMP_ATOMIC_GROUP\n", ctx->pattern, ctx->ptr));
+        goto jump_atomic_group;
+    case JUMP_POSSESSIVE_REPEAT_1:
+        TRACE(("|%p|%p|JUMP_POSSESSIVE_REPEAT_1\n", ctx->pattern, ctx->ptr));
+        goto jump_possessive_repeat_1;
+    case JUMP_POSSESSIVE_REPEAT_2:
+        TRACE(("|%p|%p|JUMP_POSSESSIVE_REPEAT_2\n", ctx->pattern, ctx->ptr));
+        goto jump_possessive_repeat_2;
     case JUMP_NONE:
         TRACE(("|%p|%p|RETURN %zd\n", ctx->pattern, ctx->ptr, ret));
         break;
@@ -1282,6 +1489,68 @@ exit:
     return ret; /* should never get here */
 }
 
+#define SRE_CHARSET_CHARS_MAX 3
+
+static CorgiUInt
+sre_charset_chars(CorgiCode* set, CorgiChar* chars)
+{
+    /* lists the characters of a set of at most SRE_CHARSET_CHARS_MAX
+       characters, and returns the number of them. returns zero for other
+       sets */
+    CorgiUInt size = 0;
+    for (;;) {
+        CorgiUInt i;
+        switch (set[0]) {
+        case SRE_OP_FAILURE:
+            return size;
+        case SRE_OP_ASCII_BITMAP:
+            set += 1 + SRE_ASCII_BITMAP_WORDS;
+            break;
+        case SRE_OP_LITERAL:
+            if (size == SRE_CHARSET_CHARS_MAX) {
+                return 0;
+            }
+            chars[size] = set[1];
+            size++;
+            set += 2;
+            break;
+        case SRE_OP_CHARSET:
+            for (i = 0; i < 8; i++) {
+                CorgiCode bits = set[1 + i];
+                while (bits != 0) {
+                    if (size == SRE_CHARSET_CHARS_MAX) {
+                        return 0;
+                    }
+                    chars[size] = 32 * i + __builtin_ctz(bits);
+                    size++;
+                    bits &= bits - 1;
+                }
+            }
+            set += 9;
+            break;
+        default:
+            return 0;
+        }
+    }
+}
+
+static CorgiCode*
+sre_skip_literals(CorgiCode* pattern, CorgiInt n)
+{
+    /* skips the literal operators which match first n characters */
+    while (0 < n) {
+        if ((pattern[0] == SRE_OP_LITERAL) || (pattern[0] == SRE_OP_LITERAL_IGNORE)) {
+            pattern += 2;
+            n--;
+            continue;
+        }
+        assert((pattern[0] == SRE_OP_LITERAL_STRING) || (pattern[0] == SRE_OP_LITERAL_STRING_IGNORE));
+        n -= pattern[1];
+        pattern += 2 + pattern[1];
+    }
+    return pattern;
+}
+
 static CorgiInt
 sre_search(State* state, CorgiCode* pattern)
 {
@@ -1294,6 +1563,7 @@ sre_search(State* state, CorgiCode* pattern)
     CorgiCode* charset = NULL;
     CorgiCode* overlap = NULL;
     int flags = 0;
+    Bool ignore;
 
     if (pattern[0] == SRE_OP_INFO) {
         /* optimization info block */
@@ -1323,54 +1593,125 @@ sre_search(State* state, CorgiCode* pattern)
 
         pattern += 1 + pattern[1];
     }
+    /* the prefix and the charset are in lower case in ignore case mode */
+    ignore = flags & SRE_INFO_IGNORE ? TRUE : FALSE;
+#define SEARCH_CHAR(p) (ignore ? SRE_LOWER(*(p)) : *(p))
 
     TRACE(("prefix = %p %zd %zd\n", prefix, prefix_len, prefix_skip));
     TRACE(("charset = %p\n", charset));
 
+    if (flags & SRE_INFO_SKIP) {
+        /* pattern starts with a long prefix.  look at the character under
+           the end of the prefix, and skip by it like Horspool's algorithm */
+        CorgiCode* skip = overlap + prefix_len + 1;
+        CorgiCode chr = prefix[prefix_len - 1];
+        CorgiCode* rest = sre_skip_literals(pattern, prefix_skip);
+        end = state->end;
+        if (end - ptr < prefix_len) {
+            return 0;
+        }
+        CorgiChar* q = ptr + prefix_len - 1;
+        for (;;) {
+            if (ignore) {
+                while ((q < end) && (SRE_LOWER(q[0]) != chr)) {
+                    q += skip[SRE_SKIP_INDEX(SRE_LOWER(q[0]))];
+                }
+            }
+            else {
+                while ((q < end) && (q[0] != chr)) {
+                    q += skip[SRE_SKIP_INDEX(q[0])];
+                }
+            }
+            if (end <= q) {
+                return 0;
+            }
+            ptr = q - (prefix_len - 1);
+            CorgiInt i = prefix_len - 2;
+            while ((0 <= i) && (SEARCH_CHAR(ptr + i) == prefix[i])) {
+                i--;
+            }
+            if (i < 0) {
+                TRACE(("|%p|%p|SEARCH SKIP\n", pattern, ptr));
+                state->start = ptr;
+                state->ptr = ptr + prefix_skip;
+                if (flags & SRE_INFO_LITERAL) {
+                    return 1; /* we got all of it */
+                }
+                status = sre_match(state, rest);
+                if (status != 0) {
+                    return status;
+                }
+            }
+            q += skip[SRE_SKIP_INDEX(chr)];
+        }
+    }
+
     if (1 < prefix_len) {
         /* pattern starts with a known prefix.  use the overlap
            table to skip forward as fast as we possibly can */
-        CorgiInt i = 0;
+        CorgiInt i;
+        CorgiCode chr = prefix[0];
+        CorgiCode* rest = sre_skip_literals(pattern, prefix_skip);
         end = state->end;
+        if (end - ptr < prefix_len) {
+            return 0;
+        }
         while (ptr < end) {
-            for (;;) {
-                if (ptr[0] != prefix[i]) {
-                    if (!i) {
-                        break;
-                    }
+            /* no partial match is pending.  look for the first character
+               of the prefix without consulting the overlap table */
+            if (ignore) {
+                while ((ptr < end) && (SRE_LOWER(ptr[0]) != chr)) {
+                    ptr++;
+                }
+            }
+            else {
+                ptr = corgi_find_char(ptr, end, chr);
+            }
+            if (end <= ++ptr) {
+                return 0;
+            }
+            i = 1;
+            do {
+                if (SEARCH_CHAR(ptr) != prefix[i]) {
                     i = overlap[i];
-                } else {
-                    if (++i == prefix_len) {
-                        /* found a potential match */
-                        TRACE(("|%p|%p|SEARCH SCAN\n", pattern, ptr));
-                        state->start = ptr + 1 - prefix_len;
-                        state->ptr = ptr + 1 - prefix_len + prefix_skip;
-                        if (flags & SRE_INFO_LITERAL) {
-                            return 1; /* we got all of it */
-                        }
-                        status = sre_match(state, pattern + 2 * prefix_skip);
-                        if (status != 0) {
-                            return status;
-                        }
-                        /* close but no cigar -- try again */
-                        i = overlap[i];
+                    continue;
+                }
+                if (++i == prefix_len) {
+                    /* found a potential match */
+                    TRACE(("|%p|%p|SEARCH SCAN\n", pattern, ptr));
+                    state->start = ptr + 1 - prefix_len;
+                    state->ptr = ptr + 1 - prefix_len + prefix_skip;
+                    if (flags & SRE_INFO_LITERAL) {
+                        return 1; /* we got all of it */
                     }
-                    break;
+                    status = sre_match(state, rest);
+                    if (status != 0) {
+                        return status;
+                    }
+                    /* close but no cigar -- try again */
+                    i = overlap[i];
                 }
-            }
-            ptr++;
+                if (end <= ++ptr) {
+                    return 0;
+                }
+            } while (i != 0);
         }
         return 0;
     }
 
-    if (pattern[0] == SRE_OP_LITERAL) {
+    if ((pattern[0] == SRE_OP_LITERAL) || (pattern[0] == SRE_OP_LITERAL_IGNORE)) {
         /* pattern starts with a literal character.  this is used
            for short prefixes, and if fast search is disabled */
         CorgiCode chr = pattern[1];
         end = state->end;
         for (;;) {
-            while ((ptr < end) && (ptr[0] != chr)) {
-                ptr++;
+            if (pattern[0] == SRE_OP_LITERAL_IGNORE) {
+                while ((ptr < end) && (SRE_LOWER(ptr[0]) != chr)) {
+                    ptr++;
+                }
+            }
+            else {
+                ptr = corgi_find_char(ptr, end, chr);
             }
             if (end <= ptr) {
                 return 0;
@@ -1387,11 +1728,26 @@ sre_search(State* state, CorgiCode* pattern)
             }
         }
     } else if (charset) {
-        /* pattern starts with a character from a known set */
+        /* pattern starts with a character from a known set.  a set of a
+           few characters is scanned for them directly */
+        CorgiChar chars[SRE_CHARSET_CHARS_MAX];
+        CorgiUInt size = ignore ? 0 : sre_charset_chars(charset, chars);
         end = (CorgiChar*)state->end;
         for (;;) {
-            while ((ptr < end) && !sre_charset(charset, ptr[0])) {
-                ptr++;
+            if (0 < size) {
+                ptr = corgi_find_chars(ptr, end, chars, size);
+            }
+            else if (charset[0] == SRE_OP_ASCII_BITMAP) {
+                /* the kernel stops at a non-ASCII character too */
+                ptr = corgi_find_ascii(ptr, end, SRE_ASCII_BITMAP_TABLE(charset));
+                while ((ptr < end) && !sre_charset(charset, SEARCH_CHAR(ptr))) {
+                    ptr = corgi_find_ascii(ptr + 1, end, SRE_ASCII_BITMAP_TABLE(charset));
+                }
+            }
+            else {
+                while ((ptr < end) && !sre_charset(charset, SEARCH_CHAR(ptr))) {
+                    ptr++;
+                }
             }
             if (end <= ptr) {
                 return 0;
@@ -1417,10 +1773,236 @@ sre_search(State* state, CorgiCode* pattern)
             }
         }
     }
+#undef SEARCH_CHAR
+
+    return status;
+}
+
+static CorgiInt
+sre_search_string(State* state, CorgiCode* pattern)
+{
+    /* a pattern anchored with \A can match only at beginning of string */
+    if (state->start != state->beginning) {
+        return 0;
+    }
+    TRACE(("|%p|%p|SEARCH STRING\n", pattern, state->start));
+    state->ptr = state->start;
+    return sre_match(state, pattern);
+}
+
+static Bool
+sre_can_start_with(CorgiCode* pattern, CorgiChar ch)
+{
+    /* tells from the INFO block whether a match can start with ch */
+    if (pattern[0] != SRE_OP_INFO) {
+        return TRUE;
+    }
+    CorgiCode flags = pattern[2];
+    if (flags & SRE_INFO_IGNORE) {
+        ch = SRE_LOWER(ch);
+    }
+    if (flags & SRE_INFO_PREFIX) {
+        return ch == pattern[7];
+    }
+    if (flags & SRE_INFO_CHARSET) {
+        return sre_charset(pattern + 5, ch);
+    }
+    return TRUE;
+}
+
+static CorgiChar*
+find_literal(CorgiChar* ptr, CorgiChar* end, CorgiChar* literal, CorgiUInt size)
+{
+    /* returns the first occurrence of the literal from ptr, or NULL */
+    if ((CorgiUInt)(end - ptr) < size) {
+        return NULL;
+    }
+    CorgiChar* last = end - size;
+    CorgiChar c = literal[0];
+    for (; ptr <= last; ptr++) {
+        ptr = corgi_find_char(ptr, last + 1, c);
+        if (last < ptr) {
+            return NULL;
+        }
+        CorgiUInt i = 1;
+        while ((i < size) && (ptr[i] == literal[i])) {
+            i++;
+        }
+        if (i == size) {
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+static CorgiInt
+sre_search_required(State* state, CorgiCode* pattern)
+{
+    /* a match starts from required_min to required_max characters before an
+       occurrence of the required literal. so sre_match() is tried only in
+       that window of each occurrence */
+    CorgiRegexp* regexp = state->regexp;
+    CorgiUInt min = regexp->required_min;
+    CorgiUInt max = regexp->required_max;
+    CorgiChar* ptr = state->start;
+    CorgiChar* end = state->end;
+    while (min <= (CorgiUInt)(end - ptr)) {
+        CorgiChar* found = find_literal(ptr + min, end, regexp->required, regexp->required_size);
+        if (found == NULL) {
+            return 0;
+        }
+        if (max < (CorgiUInt)(found - ptr)) {
+            /* an earlier start cannot reach the occurrence */
+            ptr = found - max;
+        }
+        CorgiChar* last = found - min;
+        for (; ptr <= last; ptr++) {
+            if (!sre_can_start_with(pattern, *ptr)) {
+                continue;
+            }
+            TRACE(("|%p|%p|SEARCH REQUIRED\n", pattern, ptr));
+            state->start = state->ptr = ptr;
+            CorgiInt status = sre_match(state, pattern);
+            if (status != 0) {
+                return status;
+            }
+        }
+    }
+    return 0;
+}
+
+#define REVERSE_BUFFER_SIZE 256
+
+struct Reverse {
+    CorgiChar buffer[REVERSE_BUFFER_SIZE];
+    CorgiChar* s;   /* a reversed copy of a part of the string */
+    CorgiUInt size;
+};
+
+typedef struct Reverse Reverse;
+
+static CorgiInt
+sre_match_reverse(State* state, Reverse* reverse, CorgiChar* begin, CorgiChar* end, CorgiChar** start)
+{
+    /* runs the reverse program over the reversed string from end back to
+       begin. *start is the beginning of the found match */
+    CorgiUInt size = end - begin;
+    if (reverse->size < size) {
+        CorgiChar* s = reverse->s != reverse->buffer ? reverse->s : NULL;
+        s = (CorgiChar*)realloc(s, sizeof(CorgiChar) * size);
+        if (s == NULL) {
+            return SRE_ERROR_MEMORY;
+        }
+        reverse->s = s;
+        reverse->size = size;
+    }
+    CorgiChar* s = reverse->s;
+    CorgiUInt i;
+    for (i = 0; i < size; i++) {
+        s[i] = end[-1 - i];
+    }
+    /* the reverse program has no MARK. so it can share the state */
+    CorgiChar* beginning = state->beginning;
+    CorgiChar* string_end = state->end;
+    state->beginning = state->start = state->ptr = s;
+    state->end = s + size;
+    CorgiInt status = sre_match(state, state->regexp->reverse_code);
+    *start = end - (state->ptr - s);
+    state->beginning = beginning;
+    state->end = string_end;
+    return status;
+}
+
+static CorgiInt
+search_reverse(State* state, Reverse* reverse, CorgiCode* pattern)
+{
+    CorgiRegexp* regexp = state->regexp;
+    CorgiChar* ptr = state->start;
+    CorgiChar* end = state->end;
+    CorgiChar* line = ptr;
+    CorgiChar* e = ptr;
+    if (regexp->end_anchor == CORGI_ANCHOR_STRING) {
+        for (line = e = end; (ptr < line) && !SRE_IS_LINEBREAK(line[-1]); line--) {
+        }
+    }
+    for (; e <= end; e++) {
+        e = SRE_FIND_LINEBREAK(e, end);
+        /* no match starts before the beginning of the window */
+        CorgiChar* begin = regexp->single_line && (ptr < line) ? line : ptr;
+        CorgiUInt max = regexp->max_width;
+        if ((max != CORGI_WIDTH_UNBOUNDED) && (max < (CorgiUInt)(e - begin))) {
+            begin = e - max;
+        }
+        line = e + 1;
+        if ((CorgiUInt)(e - begin) < regexp->min_width) {
+            continue;
+        }
+        if ((begin < e) && !sre_can_start_with(regexp->reverse_code, e[-1])) {
+            continue;
+        }
+        TRACE(("|%p|%p|SEARCH REVERSE\n", pattern, e));
+        CorgiChar* start = NULL;
+        CorgiInt status = sre_match_reverse(state, reverse, begin, e, &start);
+        if (status < 0) {
+            return status;
+        }
+        if (status == 0) {
+            continue;
+        }
+        /* the leftmost match starts at start or before it */
+        for (; begin <= start; begin++) {
+            if ((begin < end) && !sre_can_start_with(pattern, *begin)) {
+                continue;
+            }
+            state->start = state->ptr = begin;
+            status = sre_match(state, pattern);
+            if (status != 0) {
+                return status;
+            }
+        }
+        ptr = start + 1;
+    }
+    return 0;
+}
 
+static CorgiInt
+sre_search_reverse(State* state, CorgiCode* pattern)
+{
+    /* a pattern ending with $ or \Z can match only up to ends of lines or
+       the string. from each of them, the reverse program tells whether a
+       match ends there and where it starts, so sre_match() runs only in
+       front of the start */
+    Reverse reverse;
+    reverse.s = reverse.buffer;
+    reverse.size = REVERSE_BUFFER_SIZE;
+    CorgiInt status = search_reverse(state, &reverse, pattern);
+    if (reverse.s != reverse.buffer) {
+        free(reverse.s);
+    }
     return status;
 }
 
+static CorgiInt
+sre_search_line(State* state, CorgiCode* pattern)
+{
+    /* a pattern anchored with ^ can match only at beginnings of lines */
+    CorgiChar* ptr = state->start;
+    CorgiChar* end = state->end;
+    if ((state->beginning < ptr) && !SRE_IS_LINEBREAK(ptr[-1])) {
+        ptr = SRE_FIND_LINEBREAK(ptr, end) + 1;
+    }
+    while (ptr <= end) {
+        TRACE(("|%p|%p|SEARCH LINE\n", pattern, ptr));
+        state->start = state->ptr = ptr;
+        CorgiInt status = sre_match(state, pattern);
+        if (status != 0) {
+            return status;
+        }
+        ptr = SRE_FIND_LINEBREAK(ptr, end) + 1;
+    }
+    return 0;
+}
+
 static void
 state_init(State* state, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end, CorgiChar* at, Bool debug)
 {
@@ -1429,6 +2011,7 @@ state_init(State* state, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end,
     state->beginning = begin;
     state->ptr = state->start = at;
     state->end = end;
+    state->regexp = regexp;
     state->debug = debug;
 }
 
@@ -1465,10 +2048,22 @@ free_groups(CorgiGroup** groups, CorgiUInt groups_num)
     free(groups);
 }
 
+static void free_dfa(struct CorgiDfa*);
+static void free_prog(struct CorgiProg*);
+static void free_onepass(struct CorgiOnePass*);
+static void free_shift_and(struct CorgiShiftAnd*);
+
 CorgiStatus
 corgi_fini_regexp(CorgiRegexp* regexp)
 {
+    free_dfa(regexp->dfa);
+    free_prog(regexp->prog);
+    free_prog(regexp->bitstate);
+    free_onepass(regexp->onepass);
+    free_shift_and(regexp->shift_and);
     free(regexp->code);
+    free(regexp->required);
+    free(regexp->reverse_code);
     free_groups(regexp->groups, regexp->groups_num);
     return CORGI_OK;
 }
@@ -1492,6 +2087,19 @@ struct Compiler {
     CorgiUInt group_id;
     struct Node* groups;
     Bool ignore_case;
+    Bool no_capture;
+    Bool optimize;
+    CorgiUInt min_width;
+    CorgiUInt max_width;
+    CorgiUInt anchor;
+    struct Node* required;
+    CorgiUInt required_size;
+    CorgiUInt required_min;
+    CorgiUInt required_max;
+    struct Node* root;
+    CorgiCode* ascii_bitmap; /* ASCII_BITMAP waiting for the end of its set */
+    Bool dfa;
+    Bool linear;
 };
 
 typedef struct Compiler Compiler;
@@ -1505,6 +2113,8 @@ struct Storage {
 typedef struct Storage Storage;
 
 #define STORAGE_SIZE (1024 * 1024)
+/* every item is aligned as a pointer even after an odd sized string */
+#define STORAGE_ALIGN sizeof(void*)
 
 static Storage*
 alloc_storage(Storage* next)
@@ -1534,6 +2144,7 @@ alloc_from_new_storage(Storage** storage, CorgiUInt size)
 static void*
 alloc_from_storage(Storage** storage, CorgiUInt size)
 {
+    size = (size + STORAGE_ALIGN - 1) & ~(STORAGE_ALIGN - 1);
     char* pend = (char*)(*storage) + STORAGE_SIZE;
     if (pend <= (*storage)->free + size) {
         return alloc_from_new_storage(storage, size);
@@ -1561,7 +2172,7 @@ alloc(Compiler* compiler, CorgiUInt size)
 }
 
 static CorgiStatus
-init_compiler(Compiler* compiler, Bool ignore_case)
+init_compiler(Compiler* compiler, CorgiOptions opts)
 {
     bzero(compiler, sizeof(*compiler));
     Storage* storage = alloc_storage(NULL);
@@ -1569,7 +2180,11 @@ init_compiler(Compiler* compiler, Bool ignore_case)
         return ERR_OUT_OF_MEMORY;
     }
     compiler->storage = storage;
-    compiler->ignore_case = ignore_case;
+    compiler->ignore_case = opts & CORGI_OPT_IGNORE_CASE ? TRUE : FALSE;
+    compiler->no_capture = opts & CORGI_OPT_NO_CAPTURE ? TRUE : FALSE;
+    compiler->optimize = opts & CORGI_OPT_NO_OPTIMIZE ? FALSE : TRUE;
+    compiler->dfa = opts & CORGI_OPT_DFA ? TRUE : FALSE;
+    compiler->linear = opts & CORGI_OPT_LINEAR ? TRUE : FALSE;
     return CORGI_OK;
 }
 
@@ -1583,6 +2198,7 @@ fini_compiler(Compiler* compiler)
 enum NodeType {
     NODE_ANY,
     NODE_AT,
+    NODE_ATOMIC_GROUP,
     NODE_BRANCH,
     NODE_CATEGORY,
     NODE_IN,
@@ -1590,6 +2206,8 @@ enum NodeType {
     NODE_MAX_REPEAT,
     NODE_MIN_REPEAT,
     NODE_NEGATE,
+    NODE_NOT_LITERAL,
+    NODE_POSSESSIVE_REPEAT,
     NODE_RANGE,
     NODE_SUBPATTERN,
 };
@@ -1603,7 +2221,10 @@ struct Node {
             CorgiCode type;
         } at;
         struct {
-            struct Node* left;
+            struct Node* node;
+        } atomic_group;
+        struct {
+            struct Node* left;
             struct Node* right;
         } branch;
         struct {
@@ -1625,6 +2246,7 @@ struct Node {
             CorgiChar high;
         } range;
         struct {
+            Bool capture;
             CorgiUInt group_id;
             struct Node* node;
             CorgiChar* begin;
@@ -1892,28 +2514,98 @@ get_group_name(CorgiChar** pc, CorgiChar* end, CorgiChar** name_begin, CorgiChar
 
 static CorgiStatus parse_branch(Compiler*, CorgiChar**, CorgiChar*, Node**);
 
+static Bool
+is_extension(CorgiChar* pc, CorgiChar* end, CorgiChar c)
+{
+    /* (?>...) and (?:...) */
+    return (pc + 1 < end) && (pc[0] == '?') && (pc[1] == c) ? TRUE : FALSE;
+}
+
+static CorgiStatus
+parse_group_body(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node)
+{
+    CorgiStatus status = parse_branch(compiler, pc, end, node);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    if ((end <= *pc) || (**pc != ')')) {
+        return ERR_PARENTHESIS_NOT_CLOSED;
+    }
+    (*pc)++;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+parse_atomic_group(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node)
+{
+    /* (?>...) does not capture, so it does not take a group id */
+    Node* n = NULL;
+    CorgiStatus status = parse_group_body(compiler, pc, end, &n);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    status = create_node(compiler, NODE_ATOMIC_GROUP, node);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*node)->u.atomic_group.node = n;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+parse_noncapturing_group(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node)
+{
+    /* a group which does not capture only binds a sequence into one
+       pattern. a single node does not need it, except BRANCH. a sequence
+       which starts with BRANCH is confused with alternatives */
+    Node* n = NULL;
+    CorgiStatus status = parse_group_body(compiler, pc, end, &n);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    if ((n != NULL) && (n->next == NULL) && (n->type != NODE_BRANCH)) {
+        *node = n;
+        return CORGI_OK;
+    }
+    status = create_node(compiler, NODE_SUBPATTERN, node);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*node)->u.subpattern.capture = FALSE;
+    (*node)->u.subpattern.node = n;
+    return CORGI_OK;
+}
+
 static CorgiStatus
 parse_group(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node)
 {
+    if (is_extension(*pc, end, '>')) {
+        *pc += 2;
+        return parse_atomic_group(compiler, pc, end, node);
+    }
+    if (is_extension(*pc, end, ':')) {
+        *pc += 2;
+        return parse_noncapturing_group(compiler, pc, end, node);
+    }
     CorgiChar* name_begin = NULL;
     CorgiChar* name_end = NULL;
     get_group_name(pc, end, &name_begin, &name_end);
+    if (compiler->no_capture) {
+        return parse_noncapturing_group(compiler, pc, end, node);
+    }
     CorgiUInt group_id = compiler->group_id;
     compiler->group_id++;
 
     Node* n = NULL;
-    CorgiStatus status = parse_branch(compiler, pc, end, &n);
+    CorgiStatus status = parse_group_body(compiler, pc, end, &n);
     if (status != CORGI_OK) {
         return status;
     }
-    if (**pc != ')') {
-        return ERR_PARENTHESIS_NOT_CLOSED;
-    }
-    (*pc)++;
     status = create_node(compiler, NODE_SUBPATTERN, node);
     if (status != CORGI_OK) {
         return status;
     }
+    (*node)->u.subpattern.capture = TRUE;
     (*node)->u.subpattern.group_id = group_id;
     (*node)->u.subpattern.node = n;
     (*node)->u.subpattern.begin = name_begin;
@@ -1964,6 +2656,10 @@ create_repeat_node(Compiler* compiler, CorgiChar** pc, CorgiChar* end, CorgiUInt
         (*pc)++;
         type = NODE_MIN_REPEAT;
     }
+    else if ((*pc < end) && (**pc == '+')) {
+        (*pc)++;
+        type = NODE_POSSESSIVE_REPEAT;
+    }
     else {
         type = NODE_MAX_REPEAT;
     }
@@ -2053,6 +2749,11 @@ parse_repeat(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node)
 static CorgiStatus
 parse_subpattern(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node)
 {
+    if ((end <= *pc) || (**pc == '|') || (**pc == ')')) {
+        /* empty alternative */
+        *node = NULL;
+        return CORGI_OK;
+    }
     CorgiStatus status = parse_repeat(compiler, pc, end, node);
     if (status != CORGI_OK) {
         return status;
@@ -2070,11 +2771,9 @@ parse_subpattern(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node
 }
 
 static CorgiStatus
-parse_branch(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node)
+parse_alternatives(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node)
 {
-    if (end <= *pc) {
-        return CORGI_OK;
-    }
+    /* "a|b|c" is parsed into BRANCH(a, BRANCH(b, c)) */
     CorgiStatus status = create_node(compiler, NODE_BRANCH, node);
     if (status != CORGI_OK) {
         return status;
@@ -2094,7 +2793,7 @@ parse_branch(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node)
     (*pc)++;
 
     Node* right = NULL;
-    status = parse_subpattern(compiler, pc, end, &right);
+    status = parse_alternatives(compiler, pc, end, &right);
     if (status != CORGI_OK) {
         return status;
     }
@@ -2103,23 +2802,266 @@ parse_branch(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node)
     return CORGI_OK;
 }
 
+static Bool
+is_single_char_alternative(Node* node)
+{
+    /* returns TRUE when the alternative can be a member of a set */
+    if ((node == NULL) || (node->next != NULL)) {
+        return FALSE;
+    }
+    Node* n;
+    switch (node->type) {
+    case NODE_CATEGORY:
+    case NODE_LITERAL:
+        return TRUE;
+    case NODE_IN:
+        for (n = node->u.in.set; n != NULL; n = n->next) {
+            if (n->type == NODE_NEGATE) {
+                return FALSE;
+            }
+        }
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static CorgiStatus
+copy_set_item(Compiler* compiler, Node* node, Node*** last)
+{
+    CorgiStatus status = create_node(compiler, node->type, *last);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (**last)->u = node->u;
+    *last = &(**last)->next;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+alternatives2in(Compiler* compiler, Node** alts, CorgiUInt size, Node** node)
+{
+    /* (a|[bc]|\d) is same as [abc\d], because all alternatives match one
+       character and nothing else */
+    CorgiStatus status = create_node(compiler, NODE_IN, node);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Node** last = &(*node)->u.in.set;
+    CorgiUInt i;
+    for (i = 0; i < size; i++) {
+        Node* alt = alts[i];
+        if (alt->type != NODE_IN) {
+            status = copy_set_item(compiler, alt, &last);
+            if (status != CORGI_OK) {
+                return status;
+            }
+            continue;
+        }
+        Node* n;
+        for (n = alt->u.in.set; n != NULL; n = n->next) {
+            status = copy_set_item(compiler, n, &last);
+            if (status != CORGI_OK) {
+                return status;
+            }
+        }
+    }
+    return CORGI_OK;
+}
+
+static CorgiStatus
+alternatives2branch(Compiler* compiler, Node** alts, CorgiUInt size, Node** node)
+{
+    if (size == 1) {
+        *node = alts[0];
+        return CORGI_OK;
+    }
+    CorgiStatus status = create_node(compiler, NODE_BRANCH, node);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*node)->u.branch.left = alts[0];
+    return alternatives2branch(compiler, alts + 1, size - 1, &(*node)->u.branch.right);
+}
+
+static CorgiChar
+get_alternative_key(Compiler* compiler, Node* node)
+{
+    CorgiChar c = node->u.literal.c;
+    return compiler->ignore_case ? corgi_tolower(c) : c;
+}
+
+static Bool
+starts_with_literal(Node* node)
+{
+    return (node != NULL) && (node->type == NODE_LITERAL) ? TRUE : FALSE;
+}
+
+static CorgiStatus optimize_alternatives(Compiler*, Node**, CorgiUInt, Node**);
+
+static CorgiStatus
+factor_alternatives(Compiler* compiler, Node** alts, CorgiUInt size, CorgiUInt* new_size)
+{
+    /* alternatives which start with a same literal are merged into one. for
+       example, (ab|c|ad) becomes (a(b|d)|c). this does not change the
+       result, because alternatives starting with different literals never
+       match at a same position. alternatives starting with other nodes stop
+       the merging */
+    Node** rest = (Node**)alloc(compiler, sizeof(Node*) * size);
+    if (rest == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiUInt n = 0;
+    CorgiUInt i = 0;
+    while (i < size) {
+        if (!starts_with_literal(alts[i])) {
+            alts[n] = alts[i];
+            n++;
+            i++;
+            continue;
+        }
+        CorgiUInt run_end;
+        for (run_end = i; (run_end < size) && starts_with_literal(alts[run_end]); run_end++) {
+        }
+        CorgiUInt j;
+        for (j = i; j < run_end; j++) {
+            Node* alt = alts[j];
+            if (alt == NULL) {
+                /* already merged */
+                continue;
+            }
+            CorgiChar key = get_alternative_key(compiler, alt);
+            CorgiUInt rest_size = 0;
+            CorgiUInt k;
+            for (k = j; k < run_end; k++) {
+                if ((alts[k] != NULL) && (get_alternative_key(compiler, alts[k]) == key)) {
+                    rest[rest_size] = alts[k]->next;
+                    rest_size++;
+                    alts[k] = NULL;
+                }
+            }
+            if (rest_size == 1) {
+                alts[n] = alt;
+                n++;
+                continue;
+            }
+            Node* head = NULL;
+            CorgiStatus status = create_literal_node(compiler, alt->u.literal.c, &head);
+            if (status != CORGI_OK) {
+                return status;
+            }
+            status = optimize_alternatives(compiler, rest, rest_size, &head->next);
+            if (status != CORGI_OK) {
+                return status;
+            }
+            alts[n] = head;
+            n++;
+        }
+        i = run_end;
+    }
+    *new_size = n;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+optimize_alternatives(Compiler* compiler, Node** alts, CorgiUInt size, Node** node)
+{
+    CorgiUInt n;
+    CorgiStatus status = factor_alternatives(compiler, alts, size, &n);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    /* runs of one character alternatives are merged into a set */
+    CorgiUInt m = 0;
+    CorgiUInt i = 0;
+    while (i < n) {
+        CorgiUInt j;
+        for (j = i; (j < n) && is_single_char_alternative(alts[j]); j++) {
+        }
+        if (j - i < 2) {
+            alts[m] = alts[i];
+            m++;
+            i++;
+            continue;
+        }
+        Node* in = NULL;
+        status = alternatives2in(compiler, alts + i, j - i, &in);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        alts[m] = in;
+        m++;
+        i = j;
+    }
+    return alternatives2branch(compiler, alts, m, node);
+}
+
+static CorgiStatus
+optimize_branch(Compiler* compiler, Node* branch, Node** node)
+{
+    CorgiUInt size = 1;
+    Node* n;
+    for (n = branch; (n != NULL) && (n->type == NODE_BRANCH); n = n->u.branch.right) {
+        size++;
+    }
+    Node** alts = (Node**)alloc(compiler, sizeof(Node*) * size);
+    if (alts == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiUInt i = 0;
+    for (n = branch; (n != NULL) && (n->type == NODE_BRANCH); n = n->u.branch.right) {
+        alts[i] = n->u.branch.left;
+        i++;
+    }
+    alts[i] = n;
+    return optimize_alternatives(compiler, alts, size, node);
+}
+
+static CorgiStatus
+parse_branch(Compiler* compiler, CorgiChar** pc, CorgiChar* end, Node** node)
+{
+    if (end <= *pc) {
+        return CORGI_OK;
+    }
+    CorgiStatus status = parse_alternatives(compiler, pc, end, node);
+    if ((status != CORGI_OK) || (*node == NULL) || ((*node)->type != NODE_BRANCH)) {
+        return status;
+    }
+    return optimize_branch(compiler, *node, node);
+}
+
 enum InstructionType {
     INST_ANY,
+    INST_ASCII_BITMAP,
     INST_AT,
+    INST_ATOMIC_GROUP,
+    INST_BIGCHARSET,
     INST_BRANCH,
     INST_CATEGORY,
+    INST_CHARSET,
     INST_FAILURE,
     INST_IN,
+    INST_IN_IGNORE,
+    INST_INFO,
     INST_JUMP,
     INST_LABEL,
     INST_LITERAL,
+    INST_LITERAL_IGNORE,
+    INST_LITERAL_STRING,
+    INST_LITERAL_STRING_IGNORE,
     INST_MARK,
     INST_MAX_UNTIL,
+    INST_MIN_REPEAT_ONE,
     INST_MIN_UNTIL,
     INST_NEGATE,
+    INST_NOT_LITERAL,
+    INST_NOT_LITERAL_IGNORE,
     INST_OFFSET,
+    INST_POSSESSIVE_REPEAT,
+    INST_POSSESSIVE_REPEAT_ONE,
     INST_RANGE,
     INST_REPEAT,
+    INST_REPEAT_ONE,
     INST_SUCCESS,
 };
 
@@ -2132,18 +3074,46 @@ struct Instruction {
         struct {
             CorgiCode type;
         } at;
+        struct {
+            struct Instruction* dest;
+        } atomic_group;
+        struct {
+            CorgiUInt count;
+            CorgiCode* data;
+        } bigcharset;
         struct {
             CorgiCode type;
         } category;
+        struct {
+            CorgiCode* bits;
+        } charset;
         struct {
             struct Instruction* dest;
         } in;
+        struct {
+            struct Instruction* dest;
+            CorgiUInt flags;
+            CorgiUInt min;
+            CorgiUInt max;
+            CorgiChar* prefix;
+            CorgiUInt prefix_len;
+            CorgiUInt prefix_skip;
+            CorgiInt* overlap;
+        } info;
         struct {
             struct Instruction* dest;
         } jump;
+        struct {
+            CorgiUInt refs;
+            struct Instruction* alias;
+        } label;
         struct {
             CorgiChar c;
         } literal;
+        struct {
+            CorgiChar* s;
+            CorgiUInt len;
+        } literal_string;
         struct {
             CorgiUInt id;
         } mark;
@@ -2218,7 +3188,7 @@ branch_child2instruction(Compiler* compiler, Node* node, Instruction* branch_las
         return status;
     }
     (*inst)->next = i;
-    Instruction* rear = get_last_instruction(i);
+    Instruction* rear = i != NULL ? get_last_instruction(i) : *inst;
 
     Instruction* jump = NULL;
     status = create_instruction(compiler, INST_JUMP, &jump);
@@ -2241,7 +3211,8 @@ branch_children2instruction(Compiler* compiler, Node* node, Instruction* branch_
         return status;
     }
     Instruction* i = NULL;
-    if (node->u.branch.right->type != NODE_BRANCH) {
+    Node* right = node->u.branch.right;
+    if ((right == NULL) || (right->type != NODE_BRANCH)) {
         status = branch_child2instruction(compiler, node->u.branch.right, branch_last, &i);
     }
     else {
@@ -2256,554 +3227,5640 @@ branch_children2instruction(Compiler* compiler, Node* node, Instruction* branch_
 
 static CorgiStatus single_node2instruction(Compiler*, Node*, Instruction**);
 
-static CorgiStatus
-in2instruction(Compiler* compiler, Node* node, Instruction** inst)
+#define BITMAP_WORDS    (65536 / 32)
+#define BLOCK_WORDS     (256 / 32)
+#define BLOCKS_NUM      (65536 / 256)
+
+static void
+set_bits(CorgiCode* bits, CorgiChar low, CorgiChar high, Bool ignore_case)
 {
-    CorgiStatus status = create_instruction(compiler, INST_IN, inst);
-    if (status != CORGI_OK) {
-        return status;
-    }
-    Instruction* dest = NULL;
-    status = create_label(compiler, &dest);
-    if (status != CORGI_OK) {
-        return status;
-    }
-    (*inst)->u.in.dest = dest;
-    Instruction* last = *inst;
-    Node* n;
-    for (n = node->u.in.set; (n != NULL) && (status == CORGI_OK); n = n->next) {
-        Instruction* i = NULL;
-        status = single_node2instruction(compiler, n, &i);
-        last->next = i;
-        last = get_last_instruction(i);
-    }
-    Instruction* failure = NULL;
-    status = create_instruction(compiler, INST_FAILURE, &failure);
-    if (status != CORGI_OK) {
-        return status;
+    /* in ignore case mode, IN_IGNORE tests lower case of a character */
+    CorgiChar c;
+    for (c = low; c <= high; c++) {
+        CorgiChar d = ignore_case ? corgi_tolower(c) : c;
+        bits[d >> 5] |= (CorgiCode)1 << (d & 31);
     }
-    last->next = failure;
-    failure->next = dest;
-    return status;
 }
 
 static CorgiStatus
-at2instruction(Compiler* compiler, Node* node, Instruction** inst)
+create_charset(Compiler* compiler, CorgiCode* bits, Instruction** inst)
 {
-    CorgiStatus status = create_instruction(compiler, INST_AT, inst);
+    /* <CHARSET> <bitmap> (32 bits per code word) */
+    CorgiStatus status = create_instruction(compiler, INST_CHARSET, inst);
     if (status != CORGI_OK) {
         return status;
     }
-    (*inst)->u.at.type = node->u.at.type;
+    CorgiCode* data = (CorgiCode*)alloc(compiler, sizeof(CorgiCode) * BLOCK_WORDS);
+    if (data == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    memcpy(data, bits, sizeof(CorgiCode) * BLOCK_WORDS);
+    (*inst)->u.charset.bits = data;
     return CORGI_OK;
 }
 
 static CorgiStatus
-branch2instruction(Compiler* compiler, Node* node, Instruction** inst)
+create_bigcharset(Compiler* compiler, CorgiCode* bits, Instruction** inst)
 {
-    assert(node->type == NODE_BRANCH);
-    CorgiStatus status = create_instruction(compiler, INST_BRANCH, inst);
-    if (status != CORGI_OK) {
-        return status;
-    }
-    Instruction* label = NULL;
-    status = create_label(compiler, &label);
+    /* <BIGCHARSET> <blockcount> <256 blockindices> <blocks> */
+    CorgiStatus status = create_instruction(compiler, INST_BIGCHARSET, inst);
     if (status != CORGI_OK) {
         return status;
     }
-    Instruction* internal = NULL;
-    status = branch_children2instruction(compiler, node, label, &internal);
-    if (status != CORGI_OK) {
-        return status;
+    unsigned char indices[BLOCKS_NUM];
+    CorgiUInt count = 0;
+    CorgiUInt i;
+    for (i = 0; i < BLOCKS_NUM; i++) {
+        CorgiCode* block = bits + BLOCK_WORDS * i;
+        CorgiUInt j;
+        for (j = 0; j < count; j++) {
+            CorgiCode* unique = bits + BLOCK_WORDS * j;
+            if (memcmp(block, unique, sizeof(CorgiCode) * BLOCK_WORDS) == 0) {
+                break;
+            }
+        }
+        if (j == count) {
+            /* bits is reused to keep unique blocks in its head */
+            memmove(bits + BLOCK_WORDS * count, block, sizeof(CorgiCode) * BLOCK_WORDS);
+            count++;
+        }
+        indices[i] = j;
     }
-    (*inst)->next = internal;
-    Instruction* failure = NULL;
-    status = create_instruction(compiler, INST_FAILURE, &failure);
-    if (status != CORGI_OK) {
-        return status;
+    CorgiUInt indices_words = sizeof(indices) / sizeof(CorgiCode);
+    CorgiUInt size = indices_words + BLOCK_WORDS * count;
+    CorgiCode* data = (CorgiCode*)alloc(compiler, sizeof(CorgiCode) * size);
+    if (data == NULL) {
+        return ERR_OUT_OF_MEMORY;
     }
-    Instruction* rear = get_last_instruction(internal);
-    rear->next = failure;
-    failure->next = label;
+    memcpy(data, indices, sizeof(indices));
+    memcpy(data + indices_words, bits, sizeof(CorgiCode) * BLOCK_WORDS * count);
+    (*inst)->u.bigcharset.count = count;
+    (*inst)->u.bigcharset.data = data;
     return CORGI_OK;
 }
 
 static CorgiStatus
-literal2instruction(Compiler* compiler, Node* node, Instruction** inst)
+create_range_instruction(Compiler* compiler, CorgiChar low, CorgiChar high, Instruction** inst)
 {
-    CorgiStatus status = create_instruction(compiler, INST_LITERAL, inst);
+    if (low == high) {
+        CorgiStatus status = create_instruction(compiler, INST_LITERAL, inst);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        (*inst)->u.literal.c = low;
+        return CORGI_OK;
+    }
+    CorgiStatus status = create_instruction(compiler, INST_RANGE, inst);
     if (status != CORGI_OK) {
         return status;
     }
-    (*inst)->u.literal.c = node->u.literal.c;
+    (*inst)->u.range.low = low;
+    (*inst)->u.range.high = high;
     return CORGI_OK;
 }
 
-static CorgiStatus
-subpattern2instruction(Compiler* compiler, Node* node, Instruction** inst)
+static Bool
+get_char_range(Node* node, CorgiChar* low, CorgiChar* high)
 {
-    CorgiStatus status = create_instruction(compiler, INST_MARK, inst);
-    if (status != CORGI_OK) {
-        return status;
+    switch (node->type) {
+    case NODE_LITERAL:
+        *low = *high = node->u.literal.c;
+        return TRUE;
+    case NODE_RANGE:
+        *low = node->u.range.low;
+        *high = node->u.range.high;
+        return TRUE;
+    default:
+        return FALSE;
     }
-    (*inst)->u.mark.id = 2 * node->u.subpattern.group_id;
-    Instruction* i = NULL;
-    status = node2instruction(compiler, node->u.subpattern.node, &i);
-    if (status != CORGI_OK) {
-        return status;
+}
+
+static CorgiStatus
+add_lower_astral(Compiler* compiler, CorgiChar low, CorgiChar high, Instruction** last)
+{
+    /* appends lower case letters of characters beyond the basic multilingual
+       plane, which are out of the bitmap */
+    CorgiChar c;
+    for (c = low; c <= high; c++) {
+        CorgiChar d = corgi_tolower(c);
+        if ((low <= d) && (d <= high)) {
+            continue;
+        }
+        CorgiStatus status = create_range_instruction(compiler, d, d, &(*last)->next);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        *last = (*last)->next;
+    }
+    return CORGI_OK;
+}
+
+static Bool
+is_worth_bitmap(Compiler* compiler, Node** items, CorgiUInt size)
+{
+    CorgiUInt n = 0;
+    CorgiUInt i;
+    for (i = 0; i < size; i++) {
+        CorgiChar low;
+        CorgiChar high;
+        if ((0 < i) && (items[i]->type == NODE_NEGATE)) {
+            /* NEGATE in the middle of a set cannot be moved */
+            return FALSE;
+        }
+        if (get_char_range(items[i], &low, &high) && (low < 65536)) {
+            /* a range cannot be folded without a bitmap */
+            n += compiler->ignore_case && (low != high) ? 2 : 1;
+        }
+    }
+    return 1 < n ? TRUE : FALSE;
+}
+
+static CorgiStatus
+charset2instruction(Compiler* compiler, Node** items, CorgiUInt size, Instruction** inst)
+{
+    /* literals and ranges in the basic multilingual plane are merged into
+       one bitmap. categories and characters beyond it are kept as they are */
+    Instruction head;
+    head.next = NULL;
+    Instruction* last = &head;
+    CorgiStatus status;
+    CorgiUInt i;
+    CorgiChar low;
+    CorgiChar high;
+    if (!is_worth_bitmap(compiler, items, size)) {
+        for (i = 0; i < size; i++) {
+            Node* node = items[i];
+            if (!get_char_range(node, &low, &high)) {
+                status = single_node2instruction(compiler, node, &last->next);
+            }
+            else if (compiler->ignore_case && (low == high)) {
+                status = create_range_instruction(compiler, corgi_tolower(low), corgi_tolower(high), &last->next);
+            }
+            else {
+                status = create_range_instruction(compiler, low, high, &last->next);
+                if ((status == CORGI_OK) && compiler->ignore_case) {
+                    last = last->next;
+                    status = add_lower_astral(compiler, 65535 < low ? low : 65536, high, &last);
+                }
+            }
+            if (status != CORGI_OK) {
+                return status;
+            }
+            last = get_last_instruction(last);
+        }
+        *inst = head.next;
+        return CORGI_OK;
+    }
+
+    CorgiCode* bits = (CorgiCode*)alloc(compiler, sizeof(CorgiCode) * BITMAP_WORDS);
+    if (bits == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    bzero(bits, sizeof(CorgiCode) * BITMAP_WORDS);
+    CorgiChar max = 0;
+    Instruction rest;
+    rest.next = NULL;
+    Instruction* rest_last = &rest;
+    for (i = 0; i < size; i++) {
+        Node* node = items[i];
+        if (!get_char_range(node, &low, &high)) {
+            Instruction** pinst = node->type == NODE_NEGATE ? &last->next : &rest_last->next;
+            status = single_node2instruction(compiler, node, pinst);
+            if (status != CORGI_OK) {
+                return status;
+            }
+            if (node->type == NODE_NEGATE) {
+                last = last->next;
+            }
+            else {
+                rest_last = rest_last->next;
+            }
+            continue;
+        }
+        if (65535 < high) {
+            CorgiChar astral_low = 65535 < low ? low : 65536;
+            status = create_range_instruction(compiler, astral_low, high, &rest_last->next);
+            if (status != CORGI_OK) {
+                return status;
+            }
+            rest_last = rest_last->next;
+            if (compiler->ignore_case) {
+                status = add_lower_astral(compiler, astral_low, high, &rest_last);
+                if (status != CORGI_OK) {
+                    return status;
+                }
+            }
+            if (65535 < low) {
+                continue;
+            }
+            high = 65535;
+        }
+        set_bits(bits, low, high, compiler->ignore_case);
+        max = max < high ? high : max;
+    }
+    if (max < 256) {
+        status = create_charset(compiler, bits, &last->next);
+    }
+    else {
+        status = create_bigcharset(compiler, bits, &last->next);
     }
-    (*inst)->next = i;
-    Instruction* mark = NULL;
-    status = create_instruction(compiler, INST_MARK, &mark);
     if (status != CORGI_OK) {
         return status;
     }
-    mark->u.mark.id = 2 * node->u.subpattern.group_id + 1;
-    get_last_instruction(i)->next = mark;
+    last->next->next = rest.next;
+    *inst = head.next;
     return CORGI_OK;
 }
 
 static CorgiStatus
-range2instruction(Compiler* compiler, Node* node, Instruction** inst)
+add_ascii_bitmap(Compiler* compiler, Instruction** set)
 {
-    CorgiStatus status = create_instruction(compiler, INST_RANGE, inst);
+    /* ASCII_BITMAP at the head of a set tells the membership of an ASCII
+       character at once. write_code() fills it at the end of the set */
+    if (!compiler->optimize) {
+        return CORGI_OK;
+    }
+    Instruction* inst = NULL;
+    CorgiStatus status = create_instruction(compiler, INST_ASCII_BITMAP, &inst);
     if (status != CORGI_OK) {
         return status;
     }
-    (*inst)->u.range.low = node->u.range.low;
-    (*inst)->u.range.high = node->u.range.high;
+    inst->next = *set;
+    *set = inst;
     return CORGI_OK;
 }
 
 static CorgiStatus
-repeat2instruction(Compiler* compiler, Node* node, InstructionType until_type, Instruction** inst)
+in2instruction(Compiler* compiler, Node* node, Instruction** inst)
 {
-    CorgiStatus status = create_instruction(compiler, INST_REPEAT, inst);
+    InstructionType type = compiler->ignore_case ? INST_IN_IGNORE : INST_IN;
+    CorgiStatus status = create_instruction(compiler, type, inst);
     if (status != CORGI_OK) {
         return status;
     }
-    (*inst)->u.repeat.min = node->u.repeat.min;
-    (*inst)->u.repeat.max = node->u.repeat.max;
     Instruction* dest = NULL;
     status = create_label(compiler, &dest);
     if (status != CORGI_OK) {
         return status;
     }
-    (*inst)->u.repeat.dest = dest;
-    Instruction* i = NULL;
-    status = single_node2instruction(compiler, node->u.repeat.body, &i);
+    (*inst)->u.in.dest = dest;
+    CorgiUInt size = 0;
+    Node* n;
+    for (n = node->u.in.set; n != NULL; n = n->next) {
+        size++;
+    }
+    Node** items = (Node**)alloc(compiler, sizeof(Node*) * size);
+    if (items == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiUInt i = 0;
+    for (n = node->u.in.set; n != NULL; n = n->next) {
+        items[i] = n;
+        i++;
+    }
+    Instruction* set = NULL;
+    status = charset2instruction(compiler, items, size, &set);
     if (status != CORGI_OK) {
         return status;
     }
-    (*inst)->next = i;
-    get_last_instruction(i)->next = dest;
-    Instruction* until = NULL;
-    status = create_instruction(compiler, until_type, &until);
+    status = add_ascii_bitmap(compiler, &set);
     if (status != CORGI_OK) {
         return status;
     }
-    dest->next = until;
-    return CORGI_OK;
+    (*inst)->next = set;
+    Instruction* last = set != NULL ? get_last_instruction(set) : *inst;
+    Instruction* failure = NULL;
+    status = create_instruction(compiler, INST_FAILURE, &failure);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    last->next = failure;
+    failure->next = dest;
+    return status;
 }
 
 static CorgiStatus
-min_repeat2instruction(Compiler* compiler, Node* node, Instruction** inst)
+at2instruction(Compiler* compiler, Node* node, Instruction** inst)
 {
-    return repeat2instruction(compiler, node, INST_MIN_UNTIL, inst);
+    CorgiStatus status = create_instruction(compiler, INST_AT, inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->u.at.type = node->u.at.type;
+    return CORGI_OK;
 }
 
 static CorgiStatus
-max_repeat2instruction(Compiler* compiler, Node* node, Instruction** inst)
+atomic_group2instruction(Compiler* compiler, Node* node, Instruction** inst)
 {
-    return repeat2instruction(compiler, node, INST_MAX_UNTIL, inst);
+    /* <ATOMIC_GROUP> <skip> pattern <SUCCESS> tail */
+    CorgiStatus status = create_instruction(compiler, INST_ATOMIC_GROUP, inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* dest = NULL;
+    status = create_label(compiler, &dest);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->u.atomic_group.dest = dest;
+    Instruction* i = NULL;
+    status = node2instruction(compiler, node->u.atomic_group.node, &i);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* success = NULL;
+    status = create_instruction(compiler, INST_SUCCESS, &success);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    if (i == NULL) {
+        (*inst)->next = success;
+    }
+    else {
+        (*inst)->next = i;
+        get_last_instruction(i)->next = success;
+    }
+    success->next = dest;
+    return CORGI_OK;
 }
 
 static CorgiStatus
-any2instruction(Compiler* compiler, Node* node, Instruction** inst)
+branch2instruction(Compiler* compiler, Node* node, Instruction** inst)
 {
-    return create_instruction(compiler, INST_ANY, inst);
+    assert(node->type == NODE_BRANCH);
+    CorgiStatus status = create_instruction(compiler, INST_BRANCH, inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* label = NULL;
+    status = create_label(compiler, &label);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* internal = NULL;
+    status = branch_children2instruction(compiler, node, label, &internal);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->next = internal;
+    Instruction* failure = NULL;
+    status = create_instruction(compiler, INST_FAILURE, &failure);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* rear = get_last_instruction(internal);
+    rear->next = failure;
+    failure->next = label;
+    return CORGI_OK;
 }
 
 static CorgiStatus
-category2instruction(Compiler* compiler, Node* node, Instruction** inst)
+literal2instruction(Compiler* compiler, Node* node, Instruction** inst)
 {
-    CorgiStatus status = create_instruction(compiler, INST_CATEGORY, inst);
+    if (compiler->ignore_case) {
+        /* LITERAL_IGNORE compares lower case of a character with the operand */
+        CorgiStatus status = create_instruction(compiler, INST_LITERAL_IGNORE, inst);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        (*inst)->u.literal.c = corgi_tolower(node->u.literal.c);
+        return CORGI_OK;
+    }
+    CorgiStatus status = create_instruction(compiler, INST_LITERAL, inst);
     if (status != CORGI_OK) {
         return status;
     }
-    (*inst)->u.category.type = node->u.category.type;
+    (*inst)->u.literal.c = node->u.literal.c;
     return CORGI_OK;
 }
 
 static CorgiStatus
-single_node2instruction(Compiler* compiler, Node* node, Instruction** inst)
+not_literal2instruction(Compiler* compiler, Node* node, Instruction** inst)
 {
-    CorgiStatus (*f)(Compiler*, Node*, Instruction**);
-    switch (node->type) {
-    case NODE_ANY:
-        f = any2instruction;
-        break;
-    case NODE_AT:
-        f = at2instruction;
-        break;
-    case NODE_BRANCH:
-        f = branch2instruction;
-        break;
-    case NODE_CATEGORY:
-        f = category2instruction;
-        break;
-    case NODE_IN:
-        f = in2instruction;
-        break;
-    case NODE_LITERAL:
-        f = literal2instruction;
-        break;
-    case NODE_MAX_REPEAT:
-        f = max_repeat2instruction;
-        break;
-    case NODE_MIN_REPEAT:
-        f = min_repeat2instruction;
-        break;
-    case NODE_NEGATE:
-        return create_instruction(compiler, INST_NEGATE, inst);
-    case NODE_RANGE:
-        f = range2instruction;
-        break;
-    case NODE_SUBPATTERN:
-        f = subpattern2instruction;
-        break;
-    default:
-        return ERR_INVALID_NODE;
+    if (compiler->ignore_case) {
+        CorgiStatus status = create_instruction(compiler, INST_NOT_LITERAL_IGNORE, inst);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        (*inst)->u.literal.c = corgi_tolower(node->u.literal.c);
+        return CORGI_OK;
     }
-    return f(compiler, node, inst);
+    CorgiStatus status = create_instruction(compiler, INST_NOT_LITERAL, inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->u.literal.c = node->u.literal.c;
+    return CORGI_OK;
 }
 
 static CorgiStatus
-node2instruction(Compiler* compiler, Node* node, Instruction** inst)
+subpattern2instruction(Compiler* compiler, Node* node, Instruction** inst)
 {
-    if (node == NULL) {
-        return CORGI_OK;
+    if (!node->u.subpattern.capture) {
+        /* no MARK for a group which does not capture */
+        return node2instruction(compiler, node->u.subpattern.node, inst);
     }
-    CorgiStatus status = single_node2instruction(compiler, node, inst);
+    CorgiStatus status = create_instruction(compiler, INST_MARK, inst);
     if (status != CORGI_OK) {
         return status;
     }
+    (*inst)->u.mark.id = 2 * node->u.subpattern.group_id;
+    Instruction* i = NULL;
+    status = node2instruction(compiler, node->u.subpattern.node, &i);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* mark = NULL;
+    status = create_instruction(compiler, INST_MARK, &mark);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    mark->u.mark.id = 2 * node->u.subpattern.group_id + 1;
+    if (i == NULL) {
+        (*inst)->next = mark;
+        return CORGI_OK;
+    }
+    (*inst)->next = i;
+    get_last_instruction(i)->next = mark;
+    return CORGI_OK;
+}
 
-    Instruction* rear = get_last_instruction(*inst);
-    Node* n = node->next;
-    while ((n != NULL) && (status == CORGI_OK)) {
-        Instruction* i = NULL;
-        status = single_node2instruction(compiler, n, &i);
-        rear->next = i;
-
-        rear = get_last_instruction(i);
-        n = n->next;
+static CorgiStatus
+range2instruction(Compiler* compiler, Node* node, Instruction** inst)
+{
+    CorgiStatus status = create_instruction(compiler, INST_RANGE, inst);
+    if (status != CORGI_OK) {
+        return status;
     }
-    return status;
+    (*inst)->u.range.low = node->u.range.low;
+    (*inst)->u.range.high = node->u.range.high;
+    return CORGI_OK;
 }
 
-static CorgiUInt
-get_operands_number(Instruction* inst)
+static CorgiStatus
+repeat2instruction(Compiler* compiler, Node* node, InstructionType until_type, Instruction** inst)
 {
-    switch (inst->type) {
-    case INST_ANY:
-        return 0;
-    case INST_AT:
-        return 1;
-    case INST_BRANCH:
-        return 0;
-    case INST_CATEGORY:
-        return 1;
-    case INST_FAILURE:
-        return 0;
-    case INST_IN:
+    CorgiStatus status = create_instruction(compiler, INST_REPEAT, inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->u.repeat.min = node->u.repeat.min;
+    (*inst)->u.repeat.max = node->u.repeat.max;
+    Instruction* dest = NULL;
+    status = create_label(compiler, &dest);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->u.repeat.dest = dest;
+    Instruction* i = NULL;
+    status = single_node2instruction(compiler, node->u.repeat.body, &i);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->next = i != NULL ? i : dest;
+    if (i != NULL) {
+        get_last_instruction(i)->next = dest;
+    }
+    Instruction* until = NULL;
+    status = create_instruction(compiler, until_type, &until);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    dest->next = until;
+    return CORGI_OK;
+}
+
+static Bool
+is_single_width(Node* node)
+{
+    if (node->next != NULL) {
+        return FALSE;
+    }
+    switch (node->type) {
+    case NODE_ANY:
+    case NODE_CATEGORY:
+    case NODE_IN:
+    case NODE_LITERAL:
+    case NODE_NOT_LITERAL:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static CorgiStatus
+repeat_one2instruction(Compiler* compiler, Node* node, InstructionType type, Instruction** inst)
+{
+    /* <REPEAT_ONE> <skip> <min> <max> item <SUCCESS> tail */
+    CorgiStatus status = create_instruction(compiler, type, inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->u.repeat.min = node->u.repeat.min;
+    (*inst)->u.repeat.max = node->u.repeat.max;
+    Instruction* dest = NULL;
+    status = create_label(compiler, &dest);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->u.repeat.dest = dest;
+    Instruction* i = NULL;
+    status = single_node2instruction(compiler, node->u.repeat.body, &i);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* success = NULL;
+    status = create_instruction(compiler, INST_SUCCESS, &success);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->next = i != NULL ? i : success;
+    if (i != NULL) {
+        get_last_instruction(i)->next = success;
+    }
+    success->next = dest;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+min_repeat2instruction(Compiler* compiler, Node* node, Instruction** inst)
+{
+    if (is_single_width(node->u.repeat.body)) {
+        return repeat_one2instruction(compiler, node, INST_MIN_REPEAT_ONE, inst);
+    }
+    return repeat2instruction(compiler, node, INST_MIN_UNTIL, inst);
+}
+
+static CorgiStatus
+max_repeat2instruction(Compiler* compiler, Node* node, Instruction** inst)
+{
+    if (is_single_width(node->u.repeat.body)) {
+        return repeat_one2instruction(compiler, node, INST_REPEAT_ONE, inst);
+    }
+    return repeat2instruction(compiler, node, INST_MAX_UNTIL, inst);
+}
+
+static CorgiStatus
+possessive_repeat2instruction(Compiler* compiler, Node* node, Instruction** inst)
+{
+    /* POSSESSIVE_REPEAT has the same layout as REPEAT_ONE. its item can be
+       any width */
+    if (is_single_width(node->u.repeat.body)) {
+        return repeat_one2instruction(compiler, node, INST_POSSESSIVE_REPEAT_ONE, inst);
+    }
+    return repeat_one2instruction(compiler, node, INST_POSSESSIVE_REPEAT, inst);
+}
+
+static CorgiStatus
+any2instruction(Compiler* compiler, Node* node, Instruction** inst)
+{
+    return create_instruction(compiler, INST_ANY, inst);
+}
+
+static CorgiStatus
+category2instruction(Compiler* compiler, Node* node, Instruction** inst)
+{
+    CorgiStatus status = create_instruction(compiler, INST_CATEGORY, inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->u.category.type = node->u.category.type;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+single_node2instruction(Compiler* compiler, Node* node, Instruction** inst)
+{
+    CorgiStatus (*f)(Compiler*, Node*, Instruction**);
+    switch (node->type) {
+    case NODE_ANY:
+        f = any2instruction;
+        break;
+    case NODE_AT:
+        f = at2instruction;
+        break;
+    case NODE_ATOMIC_GROUP:
+        f = atomic_group2instruction;
+        break;
+    case NODE_BRANCH:
+        f = branch2instruction;
+        break;
+    case NODE_CATEGORY:
+        f = category2instruction;
+        break;
+    case NODE_IN:
+        f = in2instruction;
+        break;
+    case NODE_LITERAL:
+        f = literal2instruction;
+        break;
+    case NODE_MAX_REPEAT:
+        f = max_repeat2instruction;
+        break;
+    case NODE_MIN_REPEAT:
+        f = min_repeat2instruction;
+        break;
+    case NODE_NEGATE:
+        return create_instruction(compiler, INST_NEGATE, inst);
+    case NODE_NOT_LITERAL:
+        f = not_literal2instruction;
+        break;
+    case NODE_POSSESSIVE_REPEAT:
+        f = possessive_repeat2instruction;
+        break;
+    case NODE_RANGE:
+        f = range2instruction;
+        break;
+    case NODE_SUBPATTERN:
+        f = subpattern2instruction;
+        break;
+    default:
+        return ERR_INVALID_NODE;
+    }
+    return f(compiler, node, inst);
+}
+
+static CorgiUInt
+count_literals(Node* node)
+{
+    CorgiUInt n = 0;
+    Node* p;
+    for (p = node; (p != NULL) && (p->type == NODE_LITERAL); p = p->next) {
+        n++;
+    }
+    return n;
+}
+
+static CorgiStatus
+literal_string2instruction(Compiler* compiler, Node* node, CorgiUInt len, Instruction** inst)
+{
+    /* a run of literals is compared at once */
+    InstructionType type = compiler->ignore_case ? INST_LITERAL_STRING_IGNORE : INST_LITERAL_STRING;
+    CorgiStatus status = create_instruction(compiler, type, inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    CorgiChar* s = (CorgiChar*)alloc(compiler, sizeof(CorgiChar) * len);
+    if (s == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    Node* n = node;
+    CorgiUInt i;
+    for (i = 0; i < len; i++) {
+        CorgiChar c = n->u.literal.c;
+        s[i] = compiler->ignore_case ? corgi_tolower(c) : c;
+        n = n->next;
+    }
+    (*inst)->u.literal_string.s = s;
+    (*inst)->u.literal_string.len = len;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+node2instruction(Compiler* compiler, Node* node, Instruction** inst)
+{
+    Instruction head;
+    head.next = NULL;
+    Instruction* rear = &head;
+    Node* n = node;
+    while (n != NULL) {
+        CorgiUInt len = count_literals(n);
+        CorgiStatus status;
+        if (1 < len) {
+            status = literal_string2instruction(compiler, n, len, &rear->next);
+        }
+        else {
+            status = single_node2instruction(compiler, n, &rear->next);
+            len = 1;
+        }
+        if (status != CORGI_OK) {
+            return status;
+        }
+        if (rear->next != NULL) {
+            /* an empty group has no instructions */
+            rear = get_last_instruction(rear->next);
+        }
+        CorgiUInt i;
+        for (i = 0; i < len; i++) {
+            n = n->next;
+        }
+    }
+    *inst = head.next;
+    return CORGI_OK;
+}
+
+static Bool
+collect_prefix(Node* node, CorgiChar* prefix, CorgiUInt* len)
+{
+    /* returns TRUE when all of the nodes are literals */
+    Node* n;
+    for (n = node; n != NULL; n = n->next) {
+        switch (n->type) {
+        case NODE_LITERAL:
+            if (prefix != NULL) {
+                prefix[*len] = n->u.literal.c;
+            }
+            (*len)++;
+            break;
+        case NODE_ATOMIC_GROUP:
+            if (!collect_prefix(n->u.atomic_group.node, prefix, len)) {
+                return FALSE;
+            }
+            break;
+        case NODE_SUBPATTERN:
+            if (!collect_prefix(n->u.subpattern.node, prefix, len)) {
+                return FALSE;
+            }
+            break;
+        default:
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static CorgiUInt
+count_prefix_skip(Node* node)
+{
+    /* literals at the top level can be skipped by sre_search() */
+    CorgiUInt n = 0;
+    Node* p;
+    for (p = node; (p != NULL) && (p->type == NODE_LITERAL); p = p->next) {
+        n++;
+    }
+    return n;
+}
+
+static void
+compute_overlap(CorgiChar* prefix, CorgiUInt len, CorgiInt* overlap)
+{
+    /* overlap[i] is the length of the longest proper suffix of the first
+       i + 1 characters which is also a prefix of them */
+    CorgiInt i;
+    for (i = 0; i < len; i++) {
+        CorgiInt k = 0 < i ? overlap[i - 1] + 1 : 0;
+        while ((0 < k) && (prefix[i] != prefix[k - 1])) {
+            k = 1 < k ? overlap[k - 2] + 1 : 0;
+        }
+        overlap[i] = k;
+    }
+}
+
+/* a prefix shorter than this is scanned with the overlap table only */
+#define SKIP_PREFIX_MIN 8
+
+static CorgiStatus
+analyze_prefix(Compiler* compiler, Node* node, Instruction* info)
+{
+    CorgiUInt len = 0;
+    Bool literal = collect_prefix(node, NULL, &len);
+    CorgiUInt prefix_skip = count_prefix_skip(node);
+    if ((len == 0) || ((len == 1) && (prefix_skip == 0))) {
+        /* sre_search() cannot use a one character prefix in a group. the
+           first character set does the same work */
+        return CORGI_OK;
+    }
+    CorgiChar* prefix = (CorgiChar*)alloc(compiler, sizeof(CorgiChar) * len);
+    CorgiInt* overlap = (CorgiInt*)alloc(compiler, sizeof(CorgiInt) * len);
+    if ((prefix == NULL) || (overlap == NULL)) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiUInt n = 0;
+    collect_prefix(node, prefix, &n);
+    if (compiler->ignore_case) {
+        CorgiUInt i;
+        for (i = 0; i < len; i++) {
+            prefix[i] = corgi_tolower(prefix[i]);
+        }
+        info->u.info.flags |= SRE_INFO_IGNORE;
+    }
+    compute_overlap(prefix, len, overlap);
+
+    info->u.info.flags |= SRE_INFO_PREFIX;
+    if (literal && (prefix_skip == len) && (compiler->group_id == 0)) {
+        /* sre_search() returns a literal pattern without running it, so
+           MARK of an empty group like ab() would not run */
+        info->u.info.flags |= SRE_INFO_LITERAL;
+    }
+    if (compiler->optimize && (SKIP_PREFIX_MIN <= len)) {
+        info->u.info.flags |= SRE_INFO_SKIP;
+    }
+    info->u.info.prefix = prefix;
+    info->u.info.prefix_len = len;
+    info->u.info.prefix_skip = prefix_skip;
+    info->u.info.overlap = overlap;
+    return CORGI_OK;
+}
+
+#define FIRST_SET_SIZE 32
+
+struct FirstSet {
+    Node* items[FIRST_SET_SIZE];
+    CorgiUInt size;
+};
+
+typedef struct FirstSet FirstSet;
+
+static Bool
+add_first(FirstSet* set, Node* node)
+{
+    if (FIRST_SET_SIZE <= set->size) {
+        return FALSE;
+    }
+    set->items[set->size] = node;
+    set->size++;
+    return TRUE;
+}
+
+static Bool compute_first(Node*, FirstSet*, Bool*);
+
+static Bool
+compute_single_first(Node* node, FirstSet* set, Bool* nullable)
+{
+    /* returns FALSE when the first character can be anything */
+    Node* n;
+    Bool b;
+    switch (node->type) {
+    case NODE_AT:
+        *nullable = TRUE;
+        return TRUE;
+    case NODE_ATOMIC_GROUP:
+        return compute_first(node->u.atomic_group.node, set, nullable);
+    case NODE_BRANCH:
+        if (!compute_first(node->u.branch.left, set, nullable)) {
+            return FALSE;
+        }
+        if (!compute_first(node->u.branch.right, set, &b)) {
+            return FALSE;
+        }
+        *nullable = *nullable || b;
+        return TRUE;
+    case NODE_IN:
+        for (n = node->u.in.set; n != NULL; n = n->next) {
+            if ((n->type == NODE_NEGATE) || !add_first(set, n)) {
+                return FALSE;
+            }
+        }
+        *nullable = FALSE;
+        return TRUE;
+    case NODE_CATEGORY:
+    case NODE_LITERAL:
+        *nullable = FALSE;
+        return add_first(set, node);
+    case NODE_MAX_REPEAT:
+    case NODE_MIN_REPEAT:
+    case NODE_POSSESSIVE_REPEAT:
+        if (!compute_first(node->u.repeat.body, set, nullable)) {
+            return FALSE;
+        }
+        *nullable = *nullable || (node->u.repeat.min == 0);
+        return TRUE;
+    case NODE_SUBPATTERN:
+        return compute_first(node->u.subpattern.node, set, nullable);
+    case NODE_ANY:
+    default:
+        return FALSE;
+    }
+}
+
+static Bool
+compute_first(Node* node, FirstSet* set, Bool* nullable)
+{
+    /* computes the set of characters which a match of the node sequence
+       can start with */
+    *nullable = TRUE;
+    Node* n;
+    for (n = node; (n != NULL) && *nullable; n = n->next) {
+        if (!compute_single_first(n, set, nullable)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static CorgiStatus
+analyze_charset(Compiler* compiler, Node* node, Instruction* info)
+{
+    if (info->u.info.flags & SRE_INFO_PREFIX) {
+        return CORGI_OK;
+    }
+    FirstSet set;
+    set.size = 0;
+    Bool nullable;
+    if (!compute_first(node, &set, &nullable) || nullable) {
+        return CORGI_OK;
+    }
+    Instruction* items = NULL;
+    CorgiStatus status = charset2instruction(compiler, set.items, set.size, &items);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    status = add_ascii_bitmap(compiler, &items);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    info->next = items;
+    Instruction* last = get_last_instruction(items);
+    Instruction* failure = NULL;
+    status = create_instruction(compiler, INST_FAILURE, &failure);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    last->next = failure;
+    failure->next = info->u.info.dest;
+    info->u.info.flags |= SRE_INFO_CHARSET;
+    if (compiler->ignore_case) {
+        info->u.info.flags |= SRE_INFO_IGNORE;
+    }
+    return CORGI_OK;
+}
+
+static CorgiUInt
+add_width(CorgiUInt a, CorgiUInt b)
+{
+    if ((a == CORGI_WIDTH_UNBOUNDED) || (CORGI_WIDTH_UNBOUNDED - a <= b)) {
+        return CORGI_WIDTH_UNBOUNDED;
+    }
+    return a + b;
+}
+
+static CorgiUInt
+multiply_width(CorgiUInt width, CorgiUInt n)
+{
+    /* n is a count of a repeat. 65535 means unbounded */
+    if ((width == 0) || (n == 0)) {
+        return 0;
+    }
+    if ((width == CORGI_WIDTH_UNBOUNDED) || (n == 65535) || (CORGI_WIDTH_UNBOUNDED / n <= width)) {
+        return CORGI_WIDTH_UNBOUNDED;
+    }
+    return width * n;
+}
+
+static void compute_width(Node*, CorgiUInt*, CorgiUInt*);
+
+static void
+compute_single_width(Node* node, CorgiUInt* min, CorgiUInt* max)
+{
+    CorgiUInt min2;
+    CorgiUInt max2;
+    switch (node->type) {
+    case NODE_AT:
+        *min = *max = 0;
+        break;
+    case NODE_ATOMIC_GROUP:
+        compute_width(node->u.atomic_group.node, min, max);
+        break;
+    case NODE_BRANCH:
+        compute_width(node->u.branch.left, min, max);
+        compute_width(node->u.branch.right, &min2, &max2);
+        *min = min2 < *min ? min2 : *min;
+        *max = *max < max2 ? max2 : *max;
+        break;
+    case NODE_MAX_REPEAT:
+    case NODE_MIN_REPEAT:
+    case NODE_POSSESSIVE_REPEAT:
+        compute_width(node->u.repeat.body, &min2, &max2);
+        *min = multiply_width(min2, node->u.repeat.min);
+        *max = multiply_width(max2, node->u.repeat.max);
+        break;
+    case NODE_SUBPATTERN:
+        compute_width(node->u.subpattern.node, min, max);
+        break;
+    case NODE_ANY:
+    case NODE_CATEGORY:
+    case NODE_IN:
+    case NODE_LITERAL:
+    case NODE_NOT_LITERAL:
+    default:
+        *min = *max = 1;
+        break;
+    }
+}
+
+static void
+compute_width(Node* node, CorgiUInt* min, CorgiUInt* max)
+{
+    /* computes the minimum and the maximum length of strings which the node
+       sequence matches */
+    *min = *max = 0;
+    Node* n;
+    for (n = node; n != NULL; n = n->next) {
+        CorgiUInt min2;
+        CorgiUInt max2;
+        compute_single_width(n, &min2, &max2);
+        *min = add_width(*min, min2);
+        *max = add_width(*max, max2);
+    }
+}
+
+static Bool
+is_char_node(Node* node)
+{
+    /* returns TRUE when the node matches exactly one character */
+    switch (node->type) {
+    case NODE_ANY:
+    case NODE_CATEGORY:
+    case NODE_IN:
+    case NODE_LITERAL:
+    case NODE_NOT_LITERAL:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static Bool
+is_same_char_node(Node* node1, Node* node2)
+{
+    if (node1->type != node2->type) {
+        return FALSE;
+    }
+    Node* n1;
+    Node* n2;
+    switch (node1->type) {
+    case NODE_ANY:
+    case NODE_NEGATE:
+        return TRUE;
+    case NODE_CATEGORY:
+        return node1->u.category.type == node2->u.category.type;
+    case NODE_IN:
+        n1 = node1->u.in.set;
+        n2 = node2->u.in.set;
+        while ((n1 != NULL) && (n2 != NULL) && is_same_char_node(n1, n2)) {
+            n1 = n1->next;
+            n2 = n2->next;
+        }
+        return (n1 == NULL) && (n2 == NULL);
+    case NODE_LITERAL:
+    case NODE_NOT_LITERAL:
+        return node1->u.literal.c == node2->u.literal.c;
+    case NODE_RANGE:
+        return (node1->u.range.low == node2->u.range.low) && (node1->u.range.high == node2->u.range.high);
+    default:
+        return FALSE;
+    }
+}
+
+static void
+normalize_in(Compiler* compiler, Node* node)
+{
+    /* a set of one item is the item. [^x] is NOT_LITERAL */
+    Node* item = node->u.in.set;
+    Bool negate = (item != NULL) && (item->type == NODE_NEGATE);
+    if (negate) {
+        item = item->next;
+    }
+    if ((item == NULL) || (item->next != NULL)) {
+        return;
+    }
+    CorgiChar low;
+    CorgiChar high;
+    if (get_char_range(item, &low, &high) && (low == high)) {
+        node->type = negate ? NODE_NOT_LITERAL : NODE_LITERAL;
+        node->u.literal.c = low;
+        return;
+    }
+    /* IN_IGNORE tests a category with the lower case of a character */
+    if (!negate && (item->type == NODE_CATEGORY) && !compiler->ignore_case) {
+        node->type = NODE_CATEGORY;
+        node->u.category.type = item->u.category.type;
+    }
+}
+
+static Bool
+flatten_repeat(Node* node)
+{
+    /* (?:x*)*, (?:x+)* and (?:x*)+ are x*. (?:x+)+ is x+. a count between
+       the minimum and the maximum never gets lost, because an inner repeat
+       takes one x at least and x* at most */
+    Node* body = node->u.repeat.body;
+    if ((node->type != NODE_MAX_REPEAT) || (body->type != NODE_MAX_REPEAT) || (body->next != NULL)) {
+        return FALSE;
+    }
+    if ((1 < body->u.repeat.min) || (body->u.repeat.max != 65535)) {
+        return FALSE;
+    }
+    if (!is_single_width(body->u.repeat.body)) {
+        return FALSE;
+    }
+    node->u.repeat.min *= body->u.repeat.min;
+    node->u.repeat.max = 65535;
+    node->u.repeat.body = body->u.repeat.body;
+    return TRUE;
+}
+
+static void
+normalize_repeat(Node** pnode)
+{
+    Node* node = *pnode;
+    if ((node->u.repeat.body == NULL) || (node->u.repeat.max == 0)) {
+        /* (?:)* and x{0} match an empty string */
+        *pnode = node->next;
+        return;
+    }
+    while (flatten_repeat(node)) {
+    }
+    if ((node->u.repeat.min != 1) || (node->u.repeat.max != 1)) {
+        return;
+    }
+    /* x{1} is x. a possessive one is (?>x) */
+    Node* body = node->u.repeat.body;
+    if ((node->type == NODE_POSSESSIVE_REPEAT) && !is_single_width(body)) {
+        node->type = NODE_ATOMIC_GROUP;
+        node->u.atomic_group.node = body;
+        return;
+    }
+    body->next = node->next;
+    *pnode = body;
+}
+
+static Node*
+get_last_node(Node* node)
+{
+    Node* n;
+    for (n = node; n->next != NULL; n = n->next) {
+    }
+    return n;
+}
+
+static void
+normalize_subpattern(Node** pnode, Bool single)
+{
+    /* (?:...) is needed only for a sequence in a repeat, or for BRANCH */
+    Node* node = *pnode;
+    Node* n = node->u.subpattern.node;
+    if (node->u.subpattern.capture) {
+        return;
+    }
+    if (n == NULL) {
+        *pnode = node->next;
+        return;
+    }
+    if ((n->type == NODE_BRANCH) || (single && (n->next != NULL))) {
+        return;
+    }
+    get_last_node(n)->next = node->next;
+    *pnode = n;
+}
+
+static CorgiStatus normalize_nodes(Compiler*, Node**, Bool);
+
+static CorgiStatus
+normalize_children(Compiler* compiler, Node* node)
+{
+    CorgiStatus status;
+    switch (node->type) {
+    case NODE_ATOMIC_GROUP:
+        return normalize_nodes(compiler, &node->u.atomic_group.node, FALSE);
+    case NODE_BRANCH:
+        status = normalize_nodes(compiler, &node->u.branch.left, FALSE);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        return normalize_nodes(compiler, &node->u.branch.right, FALSE);
+    case NODE_MAX_REPEAT:
+    case NODE_MIN_REPEAT:
+    case NODE_POSSESSIVE_REPEAT:
+        /* a body of a repeat is one node */
+        return normalize_nodes(compiler, &node->u.repeat.body, TRUE);
+    case NODE_SUBPATTERN:
+        return normalize_nodes(compiler, &node->u.subpattern.node, FALSE);
+    default:
+        return CORGI_OK;
+    }
+}
+
+static CorgiStatus
+normalize_node(Compiler* compiler, Node** pnode, Bool single)
+{
+    Node* node = *pnode;
+    CorgiStatus status = normalize_children(compiler, node);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    switch (node->type) {
+    case NODE_ATOMIC_GROUP:
+        if (node->u.atomic_group.node == NULL) {
+            *pnode = node->next;
+        }
+        return CORGI_OK;
+    case NODE_IN:
+        normalize_in(compiler, node);
+        return CORGI_OK;
+    case NODE_MAX_REPEAT:
+    case NODE_MIN_REPEAT:
+    case NODE_POSSESSIVE_REPEAT:
+        normalize_repeat(pnode);
+        return CORGI_OK;
+    case NODE_SUBPATTERN:
+        normalize_subpattern(pnode, single);
+        return CORGI_OK;
+    default:
+        return CORGI_OK;
+    }
+}
+
+static Bool
+is_mergeable_repeat(Node* node)
+{
+    /* a possessive repeat does not give characters back to the next one */
+    if ((node->type != NODE_MAX_REPEAT) && (node->type != NODE_MIN_REPEAT)) {
+        return FALSE;
+    }
+    Node* body = node->u.repeat.body;
+    return (body->next == NULL) && is_char_node(body);
+}
+
+static Bool
+is_mergeable_item(Node* node)
+{
+    /* literals are left for a prefix and LITERAL_STRING */
+    return is_char_node(node) && (node->type != NODE_LITERAL);
+}
+
+static Bool
+add_repeat_count(Node* node, CorgiUInt min, CorgiUInt max)
+{
+    CorgiUInt new_min = node->u.repeat.min + min;
+    Bool unbounded = (node->u.repeat.max == 65535) || (max == 65535);
+    CorgiUInt new_max = unbounded ? 65535 : node->u.repeat.max + max;
+    if ((65535 <= new_min) || (!unbounded && (65535 <= new_max))) {
+        return FALSE;
+    }
+    node->u.repeat.min = new_min;
+    node->u.repeat.max = new_max;
+    return TRUE;
+}
+
+static Bool
+merge_repeat(Node** pnode)
+{
+    /* x*x*, x*x and xx* are one repeat of x, like x{1,2}x{3} is x{4,5} */
+    Node* node = *pnode;
+    Node* next = node->next;
+    if (next == NULL) {
+        return FALSE;
+    }
+    if (is_mergeable_repeat(node) && is_mergeable_repeat(next)) {
+        if ((node->type != next->type) || !is_same_char_node(node->u.repeat.body, next->u.repeat.body)) {
+            return FALSE;
+        }
+        if (!add_repeat_count(node, next->u.repeat.min, next->u.repeat.max)) {
+            return FALSE;
+        }
+        node->next = next->next;
+        return TRUE;
+    }
+    if (is_mergeable_repeat(node) && is_mergeable_item(next)) {
+        if (!is_same_char_node(node->u.repeat.body, next) || !add_repeat_count(node, 1, 1)) {
+            return FALSE;
+        }
+        node->next = next->next;
+        return TRUE;
+    }
+    if (is_mergeable_item(node) && is_mergeable_repeat(next)) {
+        if (!is_same_char_node(node, next->u.repeat.body) || !add_repeat_count(next, 1, 1)) {
+            return FALSE;
+        }
+        *pnode = next;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static CorgiStatus
+normalize_nodes(Compiler* compiler, Node** node, Bool single)
+{
+    /* rewrites a node sequence into a canonical shape. when single is TRUE,
+       the sequence must stay one node */
+    Node** p = node;
+    while (*p != NULL) {
+        Node* n = *p;
+        CorgiStatus status = normalize_node(compiler, p, single);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        if (*p == n) {
+            p = &n->next;
+        }
+    }
+    for (p = node; *p != NULL; p = &(*p)->next) {
+        while (merge_repeat(p)) {
+        }
+    }
+    return CORGI_OK;
+}
+
+static CorgiUInt compute_anchor(Node*);
+
+static CorgiUInt
+compute_single_anchor(Node* node)
+{
+    CorgiUInt anchor;
+    CorgiUInt anchor2;
+    switch (node->type) {
+    case NODE_AT:
+        switch (node->u.at.type) {
+        case SRE_AT_BEGINNING:
+        case SRE_AT_BEGINNING_STRING:
+            return CORGI_ANCHOR_STRING;
+        case SRE_AT_BEGINNING_LINE:
+            return CORGI_ANCHOR_LINE;
+        default:
+            return CORGI_ANCHOR_NONE;
+        }
+    case NODE_ATOMIC_GROUP:
+        return compute_anchor(node->u.atomic_group.node);
+    case NODE_BRANCH:
+        anchor = compute_anchor(node->u.branch.left);
+        anchor2 = compute_anchor(node->u.branch.right);
+        return anchor2 < anchor ? anchor2 : anchor;
+    case NODE_MAX_REPEAT:
+    case NODE_MIN_REPEAT:
+    case NODE_POSSESSIVE_REPEAT:
+        /* the first iteration of a required body is the beginning */
+        if (node->u.repeat.min == 0) {
+            return CORGI_ANCHOR_NONE;
+        }
+        return compute_anchor(node->u.repeat.body);
+    case NODE_SUBPATTERN:
+        return compute_anchor(node->u.subpattern.node);
+    default:
+        return CORGI_ANCHOR_NONE;
+    }
+}
+
+static CorgiUInt
+compute_anchor(Node* node)
+{
+    /* returns where every match of the node sequence starts. other
+       assertions before an anchor are skipped because they have no width */
+    Node* n;
+    for (n = node; n != NULL; n = n->next) {
+        CorgiUInt anchor = compute_single_anchor(n);
+        if ((anchor != CORGI_ANCHOR_NONE) || (n->type != NODE_AT)) {
+            return anchor;
+        }
+    }
+    return CORGI_ANCHOR_NONE;
+}
+
+static void
+find_required(Compiler* compiler, Node* node, CorgiUInt min, CorgiUInt max)
+{
+    /* looks for the longest literal run which every match of the node
+       sequence passes through. min and max are the width before it */
+    Node* n = node;
+    while (n != NULL) {
+        CorgiUInt size = 0;
+        Node* p;
+        for (p = n; (p != NULL) && (p->type == NODE_LITERAL); p = p->next) {
+            size++;
+        }
+        if (compiler->required_size < size) {
+            compiler->required = n;
+            compiler->required_size = size;
+            compiler->required_min = min;
+            compiler->required_max = max;
+        }
+        if (0 < size) {
+            min = add_width(min, size);
+            max = add_width(max, size);
+            n = p;
+            continue;
+        }
+        switch (n->type) {
+        case NODE_ATOMIC_GROUP:
+            find_required(compiler, n->u.atomic_group.node, min, max);
+            break;
+        case NODE_MAX_REPEAT:
+        case NODE_MIN_REPEAT:
+        case NODE_POSSESSIVE_REPEAT:
+            /* the first iteration of a required body is required */
+            if (0 < n->u.repeat.min) {
+                find_required(compiler, n->u.repeat.body, min, max);
+            }
+            break;
+        case NODE_SUBPATTERN:
+            find_required(compiler, n->u.subpattern.node, min, max);
+            break;
+        default:
+            break;
+        }
+        CorgiUInt min2;
+        CorgiUInt max2;
+        compute_single_width(n, &min2, &max2);
+        min = add_width(min, min2);
+        max = add_width(max, max2);
+        n = n->next;
+    }
+}
+
+static void
+analyze_required(Compiler* compiler, Node* node)
+{
+    if (compiler->ignore_case || (compiler->anchor != CORGI_ANCHOR_NONE)) {
+        return;
+    }
+    /* sre_search() scans a literal prefix as fast, and runs sre_match() only
+       where the prefix is found */
+    CorgiUInt len = 0;
+    collect_prefix(node, NULL, &len);
+    if (0 < len) {
+        return;
+    }
+    find_required(compiler, node, 0, 0);
+}
+
+static CorgiUInt
+get_end_anchor(Node* node)
+{
+    if (node->type != NODE_AT) {
+        return CORGI_ANCHOR_NONE;
+    }
+    switch (node->u.at.type) {
+    case SRE_AT_END_STRING:
+        return CORGI_ANCHOR_STRING;
+    case SRE_AT_END_LINE:
+        return CORGI_ANCHOR_LINE;
+    default:
+        return CORGI_ANCHOR_NONE;
+    }
+}
+
+static Bool
+is_reversible(Node* node)
+{
+    /* returns TRUE when the node sequence matches reversed strings after
+       reversing. assertions look at characters around, and atomic groups
+       change which strings match with the order of trials */
+    Node* n;
+    for (n = node; n != NULL; n = n->next) {
+        switch (n->type) {
+        case NODE_AT:
+        case NODE_ATOMIC_GROUP:
+        case NODE_POSSESSIVE_REPEAT:
+            return FALSE;
+        case NODE_BRANCH:
+            if (!is_reversible(n->u.branch.left) || !is_reversible(n->u.branch.right)) {
+                return FALSE;
+            }
+            break;
+        case NODE_MAX_REPEAT:
+        case NODE_MIN_REPEAT:
+            if (!is_reversible(n->u.repeat.body)) {
+                return FALSE;
+            }
+            break;
+        case NODE_SUBPATTERN:
+            if (!is_reversible(n->u.subpattern.node)) {
+                return FALSE;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return TRUE;
+}
+
+static Bool
+is_linebreak_in(Node* node)
+{
+    /* returns TRUE when a linebreak may be in the set */
+    Bool negate = FALSE;
+    Bool found = FALSE;
+    Node* item;
+    for (item = node->u.in.set; item != NULL; item = item->next) {
+        switch (item->type) {
+        case NODE_CATEGORY:
+            found = found || sre_category(item->u.category.type, '\n');
+            break;
+        case NODE_LITERAL:
+            found = found || SRE_IS_LINEBREAK(item->u.literal.c);
+            break;
+        case NODE_NEGATE:
+            negate = TRUE;
+            break;
+        case NODE_RANGE:
+            found = found || ((item->u.range.low <= '\n') && ('\n' <= item->u.range.high));
+            break;
+        default:
+            return TRUE;
+        }
+    }
+    return negate ? !found : found;
+}
+
+static Bool
+can_match_linebreak(Node* node)
+{
+    /* returns TRUE when a string which the node sequence matches may
+       contain a linebreak */
+    Node* n;
+    for (n = node; n != NULL; n = n->next) {
+        switch (n->type) {
+        case NODE_ANY:
+        case NODE_AT:
+            break;
+        case NODE_ATOMIC_GROUP:
+            if (can_match_linebreak(n->u.atomic_group.node)) {
+                return TRUE;
+            }
+            break;
+        case NODE_BRANCH:
+            if (can_match_linebreak(n->u.branch.left) || can_match_linebreak(n->u.branch.right)) {
+                return TRUE;
+            }
+            break;
+        case NODE_CATEGORY:
+            if (sre_category(n->u.category.type, '\n')) {
+                return TRUE;
+            }
+            break;
+        case NODE_IN:
+            if (is_linebreak_in(n)) {
+                return TRUE;
+            }
+            break;
+        case NODE_LITERAL:
+            if (SRE_IS_LINEBREAK(n->u.literal.c)) {
+                return TRUE;
+            }
+            break;
+        case NODE_MAX_REPEAT:
+        case NODE_MIN_REPEAT:
+        case NODE_POSSESSIVE_REPEAT:
+            if (can_match_linebreak(n->u.repeat.body)) {
+                return TRUE;
+            }
+            break;
+        case NODE_NOT_LITERAL:
+            if (!SRE_IS_LINEBREAK(n->u.literal.c)) {
+                return TRUE;
+            }
+            break;
+        case NODE_SUBPATTERN:
+            if (can_match_linebreak(n->u.subpattern.node)) {
+                return TRUE;
+            }
+            break;
+        default:
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static CorgiStatus reverse_nodes(Compiler*, Node**);
+
+static CorgiStatus
+reverse_children(Compiler* compiler, Node* node)
+{
+    CorgiStatus status;
+    switch (node->type) {
+    case NODE_BRANCH:
+        status = reverse_nodes(compiler, &node->u.branch.left);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        return reverse_nodes(compiler, &node->u.branch.right);
+    case NODE_MAX_REPEAT:
+    case NODE_MIN_REPEAT:
+        return reverse_nodes(compiler, &node->u.repeat.body);
+    case NODE_SUBPATTERN:
+        /* the reverse program does not capture */
+        node->u.subpattern.capture = FALSE;
+        return reverse_nodes(compiler, &node->u.subpattern.node);
+    default:
+        return CORGI_OK;
+    }
+}
+
+static CorgiStatus
+reverse_nodes(Compiler* compiler, Node** node)
+{
+    /* reverses a node sequence so that it matches reversed strings */
+    Node* reversed = NULL;
+    Node* n = *node;
+    while (n != NULL) {
+        CorgiStatus status = reverse_children(compiler, n);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        Node* next = n->next;
+        n->next = reversed;
+        reversed = n;
+        n = next;
+    }
+    if ((reversed != NULL) && (reversed->type == NODE_BRANCH) && (reversed->next != NULL)) {
+        /* a sequence starting with BRANCH looks like more alternatives */
+        Node* subpattern = NULL;
+        CorgiStatus status = create_node(compiler, NODE_SUBPATTERN, &subpattern);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        subpattern->u.subpattern.capture = FALSE;
+        subpattern->u.subpattern.node = reversed;
+        subpattern->next = reversed->next;
+        reversed->next = NULL;
+        reversed = subpattern;
+    }
+    *node = reversed;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+info2instruction(Compiler* compiler, Node* node, Instruction** inst)
+{
+    CorgiStatus status = create_instruction(compiler, INST_INFO, inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* dest = NULL;
+    status = create_label(compiler, &dest);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    (*inst)->u.info.dest = dest;
+    CorgiUInt min;
+    CorgiUInt max;
+    compute_width(node, &min, &max);
+    compiler->min_width = min;
+    compiler->max_width = max;
+    compiler->anchor = compute_anchor(node);
+    analyze_required(compiler, node);
+    /* INFO keeps widths in 16 bits like repeat counts */
+    (*inst)->u.info.min = min < 65535 ? min : 65535;
+    (*inst)->u.info.max = max < 65535 ? max : 65535;
+    (*inst)->next = dest;
+    status = analyze_prefix(compiler, node, *inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    return analyze_charset(compiler, node, *inst);
+}
+
+static CorgiUInt
+get_operands_number(Instruction* inst)
+{
+    switch (inst->type) {
+    case INST_ANY:
+        return 0;
+    case INST_ASCII_BITMAP:
+        return SRE_ASCII_BITMAP_WORDS;
+    case INST_AT:
+        return 1;
+    case INST_ATOMIC_GROUP:
+        return 1;
+    case INST_BIGCHARSET:
+        return 1 + BLOCKS_NUM / sizeof(CorgiCode) + BLOCK_WORDS * inst->u.bigcharset.count;
+    case INST_BRANCH:
+        return 0;
+    case INST_CATEGORY:
+        return 1;
+    case INST_CHARSET:
+        return BLOCK_WORDS;
+    case INST_FAILURE:
+        return 0;
+    case INST_IN:
+    case INST_IN_IGNORE:
         return 1;
+    case INST_INFO:
+        /* <skip> <flags> <min> <max> [<length> <skip> <prefix> <overlap> [<table>]] */
+        if (inst->u.info.flags & SRE_INFO_SKIP) {
+            return 6 + 2 * inst->u.info.prefix_len + SRE_SKIP_TABLE_SIZE;
+        }
+        if (inst->u.info.flags & SRE_INFO_PREFIX) {
+            return 6 + 2 * inst->u.info.prefix_len;
+        }
+        return 4;
     case INST_JUMP:
         return 1;
     case INST_LITERAL:
-        return 1;
+    case INST_LITERAL_IGNORE:
+        return 1;
+    case INST_LITERAL_STRING:
+    case INST_LITERAL_STRING_IGNORE:
+        return 1 + inst->u.literal_string.len;
+    case INST_MARK:
+        return 1;
+    case INST_MAX_UNTIL:
+        return 0;
+    case INST_MIN_REPEAT_ONE:
+        return 3;
+    case INST_MIN_UNTIL:
+        return 0;
+    case INST_NEGATE:
+        return 0;
+    case INST_NOT_LITERAL:
+    case INST_NOT_LITERAL_IGNORE:
+        return 1;
+    case INST_OFFSET:
+        return 0;
+    case INST_POSSESSIVE_REPEAT:
+    case INST_POSSESSIVE_REPEAT_ONE:
+        return 3;
+    case INST_RANGE:
+        return 2;
+    case INST_REPEAT:
+    case INST_REPEAT_ONE:
+        return 3;
+    case INST_SUCCESS:
+        return 0;
+    case INST_LABEL:
+    default:
+        assert(FALSE);
+    }
+
+    return 0; /* gcc dislike this function without this statement */
+}
+
+static CorgiUInt
+get_instruction_size(Instruction* inst)
+{
+    if (inst->type == INST_LABEL) {
+        return 0;
+    }
+    return 1 + get_operands_number(inst);
+}
+
+static CorgiUInt
+compute_instruction_position(Instruction* inst)
+{
+    CorgiUInt pos = 0;
+    Instruction* i;
+    for (i = inst; i != NULL; i = i->next) {
+        i->pos = pos;
+        pos += get_instruction_size(i);
+    }
+    return pos;
+}
+
+static void
+write_info(CorgiCode** code, Instruction* inst)
+{
+    **code = SRE_OP_INFO;
+    (*code)++;
+    **code = inst->u.info.dest->pos - inst->pos - 1;
+    (*code)++;
+    **code = inst->u.info.flags;
+    (*code)++;
+    **code = inst->u.info.min;
+    (*code)++;
+    **code = inst->u.info.max;
+    (*code)++;
+    if ((inst->u.info.flags & SRE_INFO_PREFIX) == 0) {
+        return;
+    }
+    CorgiUInt len = inst->u.info.prefix_len;
+    **code = len;
+    (*code)++;
+    **code = inst->u.info.prefix_skip;
+    (*code)++;
+    memcpy(*code, inst->u.info.prefix, sizeof(CorgiCode) * len);
+    (*code) += len;
+    CorgiUInt i;
+    for (i = 0; i < len; i++) {
+        **code = inst->u.info.overlap[i];
+        (*code)++;
+    }
+    if ((inst->u.info.flags & SRE_INFO_SKIP) == 0) {
+        return;
+    }
+    /* how far the prefix can move when its last character is at a place */
+    CorgiChar* prefix = inst->u.info.prefix;
+    for (i = 0; i < SRE_SKIP_TABLE_SIZE; i++) {
+        (*code)[i] = len;
+    }
+    for (i = 0; i < len - 1; i++) {
+        (*code)[SRE_SKIP_INDEX(prefix[i])] = len - 1 - i;
+    }
+    (*code) += SRE_SKIP_TABLE_SIZE;
+}
+
+static void
+write_repeat(CorgiCode** code, Instruction* inst, CorgiCode opcode)
+{
+    **code = opcode;
+    (*code)++;
+    **code = inst->u.repeat.dest->pos - inst->pos - 1;
+    (*code)++;
+    **code = inst->u.repeat.min;
+    (*code)++;
+    **code = inst->u.repeat.max;
+    (*code)++;
+}
+
+static void
+fill_ascii_bitmap(Compiler* compiler)
+{
+    /* the set after the bitmap has been written up to its FAILURE */
+    CorgiCode* bitmap = compiler->ascii_bitmap;
+    CorgiCode* set = bitmap + 1 + SRE_ASCII_BITMAP_WORDS;
+    unsigned char* table = (unsigned char*)(bitmap + 1);
+    CorgiChar c;
+    for (c = 0; c < 128; c++) {
+        if (sre_charset(set, compiler->ignore_case ? SRE_LOWER(c) : c)) {
+            table[c & 15] |= 1 << (c >> 4);
+        }
+    }
+    compiler->ascii_bitmap = NULL;
+}
+
+static void
+write_code(Compiler* compiler, CorgiCode** code, Instruction* inst)
+{
+    CorgiUInt size;
+    switch (inst->type) {
+    case INST_ANY:
+        **code = SRE_OP_ANY;
+        (*code)++;
+        break;
+    case INST_ASCII_BITMAP:
+        compiler->ascii_bitmap = *code;
+        **code = SRE_OP_ASCII_BITMAP;
+        (*code)++;
+        bzero(*code, sizeof(CorgiCode) * SRE_ASCII_BITMAP_WORDS);
+        (*code) += SRE_ASCII_BITMAP_WORDS;
+        break;
+    case INST_AT:
+        **code = SRE_OP_AT;
+        (*code)++;
+        **code = inst->u.at.type;
+        (*code)++;
+        break;
+    case INST_ATOMIC_GROUP:
+        **code = SRE_OP_ATOMIC_GROUP;
+        (*code)++;
+        **code = inst->u.atomic_group.dest->pos - inst->pos - 1;
+        (*code)++;
+        break;
+    case INST_BIGCHARSET:
+        **code = SRE_OP_BIGCHARSET;
+        (*code)++;
+        **code = inst->u.bigcharset.count;
+        (*code)++;
+        size = BLOCKS_NUM / sizeof(CorgiCode) + BLOCK_WORDS * inst->u.bigcharset.count;
+        memcpy(*code, inst->u.bigcharset.data, sizeof(CorgiCode) * size);
+        (*code) += size;
+        break;
+    case INST_BRANCH:
+        **code = SRE_OP_BRANCH;
+        (*code)++;
+        break;
+    case INST_CATEGORY:
+        **code = SRE_OP_CATEGORY;
+        (*code)++;
+        **code = inst->u.category.type;
+        (*code)++;
+        break;
+    case INST_CHARSET:
+        **code = SRE_OP_CHARSET;
+        (*code)++;
+        memcpy(*code, inst->u.charset.bits, sizeof(CorgiCode) * BLOCK_WORDS);
+        (*code) += BLOCK_WORDS;
+        break;
+    case INST_FAILURE:
+        **code = SRE_OP_FAILURE;
+        (*code)++;
+        if (compiler->ascii_bitmap != NULL) {
+            fill_ascii_bitmap(compiler);
+        }
+        break;
+    case INST_IN:
+    case INST_IN_IGNORE:
+        **code = inst->type == INST_IN ? SRE_OP_IN : SRE_OP_IN_IGNORE;
+        (*code)++;
+        **code = inst->u.in.dest->pos - inst->pos - 1;
+        (*code)++;
+        break;
+    case INST_INFO:
+        write_info(code, inst);
+        break;
+    case INST_JUMP:
+        **code = SRE_OP_JUMP;
+        (*code)++;
+        **code = inst->u.jump.dest->pos - inst->pos - 1;
+        (*code)++;
+        break;
+    case INST_LABEL:
+        break;
+    case INST_LITERAL:
+    case INST_LITERAL_IGNORE:
+        **code = inst->type == INST_LITERAL ? SRE_OP_LITERAL : SRE_OP_LITERAL_IGNORE;
+        (*code)++;
+        **code = inst->u.literal.c;
+        (*code)++;
+        break;
+    case INST_LITERAL_STRING:
+    case INST_LITERAL_STRING_IGNORE:
+        **code = inst->type == INST_LITERAL_STRING ? SRE_OP_LITERAL_STRING : SRE_OP_LITERAL_STRING_IGNORE;
+        (*code)++;
+        size = inst->u.literal_string.len;
+        **code = size;
+        (*code)++;
+        memcpy(*code, inst->u.literal_string.s, sizeof(CorgiCode) * size);
+        (*code) += size;
+        break;
     case INST_MARK:
-        return 1;
+        **code = SRE_OP_MARK;
+        (*code)++;
+        **code = inst->u.mark.id;
+        (*code)++;
+        break;
     case INST_MAX_UNTIL:
-        return 0;
+        **code = SRE_OP_MAX_UNTIL;
+        (*code)++;
+        break;
     case INST_MIN_UNTIL:
-        return 0;
+        **code = SRE_OP_MIN_UNTIL;
+        (*code)++;
+        break;
     case INST_NEGATE:
-        return 0;
+        **code = SRE_OP_NEGATE;
+        (*code)++;
+        break;
+    case INST_NOT_LITERAL:
+    case INST_NOT_LITERAL_IGNORE:
+        **code = inst->type == INST_NOT_LITERAL ? SRE_OP_NOT_LITERAL : SRE_OP_NOT_LITERAL_IGNORE;
+        (*code)++;
+        **code = inst->u.literal.c;
+        (*code)++;
+        break;
     case INST_OFFSET:
-        return 0;
+        **code = inst->u.offset.dest->pos - inst->pos;
+        (*code)++;
+        break;
     case INST_RANGE:
-        return 2;
+        **code = SRE_OP_RANGE;
+        (*code)++;
+        **code = inst->u.range.low;
+        (*code)++;
+        **code = inst->u.range.high;
+        (*code)++;
+        break;
+    case INST_MIN_REPEAT_ONE:
+        write_repeat(code, inst, SRE_OP_MIN_REPEAT_ONE);
+        break;
+    case INST_POSSESSIVE_REPEAT:
+        write_repeat(code, inst, SRE_OP_POSSESSIVE_REPEAT);
+        break;
+    case INST_POSSESSIVE_REPEAT_ONE:
+        write_repeat(code, inst, SRE_OP_POSSESSIVE_REPEAT_ONE);
+        break;
     case INST_REPEAT:
-        return 3;
+        write_repeat(code, inst, SRE_OP_REPEAT);
+        break;
+    case INST_REPEAT_ONE:
+        write_repeat(code, inst, SRE_OP_REPEAT_ONE);
+        break;
     case INST_SUCCESS:
-        return 0;
-    case INST_LABEL:
+        **code = SRE_OP_SUCCESS;
+        (*code)++;
+        break;
+    default:
+        assert(FALSE);
+    }
+}
+
+static void
+instruction2binary(Compiler* compiler, CorgiCode* code, Instruction* inst)
+{
+    CorgiCode** p = &code;
+    Instruction* i;
+    for (i = inst; i != NULL; i = i->next) {
+        write_code(compiler, p, i);
+    }
+}
+
+static CorgiStatus
+instruction2code(Compiler* compiler, Instruction* inst, CorgiCode** code, CorgiUInt* code_size)
+{
+    *code_size = compute_instruction_position(inst);
+    *code = (CorgiCode*)malloc(sizeof(CorgiCode) * *code_size);
+    if (*code == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    instruction2binary(compiler, *code, inst);
+
+    return CORGI_OK;
+}
+
+static Instruction**
+get_destination(Instruction* inst)
+{
+    switch (inst->type) {
+    case INST_ATOMIC_GROUP:
+        return &inst->u.atomic_group.dest;
+    case INST_IN:
+    case INST_IN_IGNORE:
+        return &inst->u.in.dest;
+    case INST_INFO:
+        return &inst->u.info.dest;
+    case INST_JUMP:
+        return &inst->u.jump.dest;
+    case INST_OFFSET:
+        return &inst->u.offset.dest;
+    case INST_MIN_REPEAT_ONE:
+    case INST_POSSESSIVE_REPEAT:
+    case INST_POSSESSIVE_REPEAT_ONE:
+    case INST_REPEAT:
+    case INST_REPEAT_ONE:
+        return &inst->u.repeat.dest;
+    default:
+        return NULL;
+    }
+}
+
+static void
+count_references(Instruction* inst)
+{
+    Instruction* i;
+    for (i = inst; i != NULL; i = i->next) {
+        if (i->type == INST_LABEL) {
+            i->u.label.refs = 0;
+        }
+    }
+    for (i = inst; i != NULL; i = i->next) {
+        Instruction** dest = get_destination(i);
+        if (dest != NULL) {
+            (*dest)->u.label.refs++;
+        }
+    }
+}
+
+static Instruction*
+skip_labels(Instruction* inst)
+{
+    Instruction* i = inst;
+    while ((i != NULL) && (i->type == INST_LABEL)) {
+        i = i->next;
+    }
+    return i;
+}
+
+static Bool
+is_unconditional(Instruction* inst)
+{
+    /* an instruction which never goes to the next one */
+    switch (inst->type) {
+    case INST_FAILURE:
+    case INST_JUMP:
+    case INST_SUCCESS:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static Bool
+coalesce_labels(Instruction* inst)
+{
+    /* labels in a row have one position. the first one stands for them */
+    Instruction* first = NULL;
+    Instruction* i;
+    for (i = inst; i != NULL; i = i->next) {
+        if (i->type != INST_LABEL) {
+            first = NULL;
+            continue;
+        }
+        first = first != NULL ? first : i;
+        i->u.label.alias = first;
+    }
+    for (i = inst; i != NULL; i = i->next) {
+        Instruction** dest = get_destination(i);
+        if (dest != NULL) {
+            *dest = (*dest)->u.label.alias;
+        }
+    }
+
+    count_references(inst);
+    Bool changed = FALSE;
+    Instruction* prev = inst;
+    for (i = inst->next; i != NULL; i = i->next) {
+        if ((i->type == INST_LABEL) && (i->u.label.refs == 0)) {
+            prev->next = i->next;
+            changed = TRUE;
+            continue;
+        }
+        prev = i;
+    }
+    return changed;
+}
+
+static Bool
+thread_jumps(Instruction* inst)
+{
+    Bool changed = FALSE;
+    Instruction* i;
+    for (i = inst; i != NULL; i = i->next) {
+        if (i->type != INST_JUMP) {
+            continue;
+        }
+        /* jumps go forward only. a chain of them ends */
+        Instruction* target = skip_labels(i->u.jump.dest);
+        while ((target != NULL) && (target->type == INST_JUMP)) {
+            i->u.jump.dest = target->u.jump.dest;
+            target = skip_labels(i->u.jump.dest);
+            changed = TRUE;
+        }
+        if ((target != NULL) && ((target->type == INST_FAILURE) || (target->type == INST_SUCCESS))) {
+            i->type = target->type;
+            changed = TRUE;
+        }
+    }
+    return changed;
+}
+
+static Bool
+remove_jumps_to_next(Instruction* inst)
+{
+    Bool changed = FALSE;
+    Instruction* prev = inst;
+    Instruction* i;
+    for (i = inst->next; i != NULL; i = i->next) {
+        if (i->type != INST_JUMP) {
+            prev = i;
+            continue;
+        }
+        Instruction* label = i->next;
+        while ((label != NULL) && (label->type == INST_LABEL) && (label != i->u.jump.dest)) {
+            label = label->next;
+        }
+        if (label != i->u.jump.dest) {
+            prev = i;
+            continue;
+        }
+        prev->next = i->next;
+        changed = TRUE;
+    }
+    return changed;
+}
+
+static Bool
+remove_dead_code(Instruction* inst)
+{
+    count_references(inst);
+    Bool changed = FALSE;
+    Bool dead = FALSE;
+    Instruction* prev = inst;
+    Instruction* i;
+    for (i = inst->next; i != NULL; i = i->next) {
+        if ((i->type == INST_LABEL) && (0 < i->u.label.refs)) {
+            dead = FALSE;
+        }
+        if (!dead) {
+            dead = is_unconditional(i);
+            prev = i;
+            continue;
+        }
+        /* all destinations are forward. a label loses references before it is checked */
+        Instruction** dest = get_destination(i);
+        if (dest != NULL) {
+            (*dest)->u.label.refs--;
+        }
+        prev->next = i->next;
+        changed = TRUE;
+    }
+    return changed;
+}
+
+static Bool
+is_repeat(Instruction* inst)
+{
+    switch (inst->type) {
+    case INST_MIN_REPEAT_ONE:
+    case INST_POSSESSIVE_REPEAT:
+    case INST_POSSESSIVE_REPEAT_ONE:
+    case INST_REPEAT:
+    case INST_REPEAT_ONE:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static Bool
+is_repeat_one(Instruction* inst)
+{
+    switch (inst->type) {
+    case INST_MIN_REPEAT_ONE:
+    case INST_POSSESSIVE_REPEAT_ONE:
+    case INST_REPEAT_ONE:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static Bool
+is_empty_repeat(Instruction* inst)
+{
+    Instruction* dest = inst->u.repeat.dest;
+    if ((inst->u.repeat.min == 0) && (inst->u.repeat.max == 0)) {
+        return TRUE;
+    }
+    if (inst->type == INST_REPEAT) {
+        /* <REPEAT> <skip> <min> <max> <MAX_UNTIL> */
+        return inst->next == dest;
+    }
+    /* <REPEAT_ONE> <skip> <min> <max> <SUCCESS> */
+    return (inst->next->type == INST_SUCCESS) && (inst->next->next == dest);
+}
+
+static Bool
+simplify_repeat(Instruction* prev, Instruction* inst)
+{
+    Instruction* dest = inst->u.repeat.dest;
+    if (is_empty_repeat(inst)) {
+        /* x{0} and (?:)* match an empty string */
+        prev->next = dest;
+        if (inst->type == INST_REPEAT) {
+            dest->next = dest->next->next;
+        }
+        return TRUE;
+    }
+    if (!is_repeat_one(inst) || (inst->u.repeat.min != 1) || (inst->u.repeat.max != 1)) {
+        return FALSE;
+    }
+    /* x{1} is x. drop <REPEAT_ONE> and <SUCCESS> around the item */
+    Instruction* i;
+    for (i = inst; i->next->next != dest; i = i->next) {
+    }
+    assert(i->next->type == INST_SUCCESS);
+    i->next = dest;
+    prev->next = inst->next;
+    return TRUE;
+}
+
+static Bool
+simplify_repeats(Instruction* inst)
+{
+    Bool changed = FALSE;
+    Instruction* prev = inst;
+    Instruction* i = inst->next;
+    while (i != NULL) {
+        if (is_repeat(i) && simplify_repeat(prev, i)) {
+            changed = TRUE;
+            i = prev->next;
+            continue;
+        }
+        prev = i;
+        i = i->next;
+    }
+    return changed;
+}
+
+static Bool
+is_failing_arm(Instruction* offset)
+{
+    return offset->next->type == INST_FAILURE;
+}
+
+static Bool
+is_same_arm(Instruction* offset1, Instruction* offset2)
+{
+    /* compare arms of one instruction only, like "JUMP" of an empty arm */
+    Instruction* i = offset1->next;
+    Instruction* j = offset2->next;
+    if ((i->next != offset1->u.offset.dest) || (j->next != offset2->u.offset.dest)) {
+        return FALSE;
+    }
+    if (!is_unconditional(i) || (i->type != j->type)) {
+        return FALSE;
+    }
+    return (i->type != INST_JUMP) || (skip_labels(i->u.jump.dest) == skip_labels(j->u.jump.dest));
+}
+
+static Bool
+is_redundant_arm(Instruction* branch, Instruction* offset)
+{
+    if (is_failing_arm(offset)) {
+        return TRUE;
+    }
+    /* an arm same as former one fails again after the former one failed */
+    Instruction* i;
+    for (i = branch->next; i != offset; i = i->u.offset.dest->next) {
+        if (is_same_arm(i, offset)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static Bool
+simplify_branch(Instruction* prev, Instruction* branch)
+{
+    /* <BRANCH> <0=skip> code <JUMP> ... <NULL> */
+    Bool changed = FALSE;
+    CorgiUInt arms = 0;
+    Instruction* last = branch;
+    Instruction* offset = branch->next;
+    while (offset->type == INST_OFFSET) {
+        Instruction* label = offset->u.offset.dest;
+        if (is_redundant_arm(branch, offset)) {
+            last->next = label->next;
+            changed = TRUE;
+        }
+        else {
+            arms++;
+            last = label;
+        }
+        offset = label->next;
+    }
+    assert(offset->type == INST_FAILURE);
+    if (arms == 0) {
+        /* no arms can match */
+        prev->next = offset;
+        return TRUE;
+    }
+    if (1 < arms) {
+        return changed;
+    }
+    /* a branch of one arm is the arm itself */
+    offset = branch->next;
+    Instruction* i;
+    for (i = offset; i->next != offset->u.offset.dest; i = i->next) {
+    }
+    i->next = last->next->next;
+    prev->next = offset->next;
+    return TRUE;
+}
+
+static Bool
+simplify_branches(Instruction* inst)
+{
+    Bool changed = FALSE;
+    Instruction* prev = inst;
+    Instruction* i = inst->next;
+    while (i != NULL) {
+        if ((i->type == INST_BRANCH) && simplify_branch(prev, i)) {
+            changed = TRUE;
+            i = prev->next;
+            continue;
+        }
+        prev = i;
+        i = i->next;
+    }
+    return changed;
+}
+
+static Bool
+is_literal_instruction(Instruction* inst)
+{
+    switch (inst->type) {
+    case INST_LITERAL:
+    case INST_LITERAL_IGNORE:
+    case INST_LITERAL_STRING:
+    case INST_LITERAL_STRING_IGNORE:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static Bool
+is_literal_string_instruction(Instruction* inst)
+{
+    return (inst->type == INST_LITERAL_STRING) || (inst->type == INST_LITERAL_STRING_IGNORE);
+}
+
+static CorgiStatus
+merge_literal_run(Compiler* compiler, Instruction* inst)
+{
+    CorgiUInt len = 0;
+    Instruction* i;
+    for (i = inst; (i != NULL) && is_literal_instruction(i); i = i->next) {
+        len += is_literal_string_instruction(i) ? i->u.literal_string.len : 1;
+    }
+    CorgiChar* s = (CorgiChar*)alloc(compiler, sizeof(CorgiChar) * len);
+    if (s == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiUInt n = 0;
+    for (i = inst; (i != NULL) && is_literal_instruction(i); i = i->next) {
+        if (!is_literal_string_instruction(i)) {
+            s[n] = i->u.literal.c;
+            n++;
+            continue;
+        }
+        memcpy(s + n, i->u.literal_string.s, sizeof(CorgiChar) * i->u.literal_string.len);
+        n += i->u.literal_string.len;
+    }
+    /* operands of LITERAL_IGNORE are already in lower case */
+    inst->type = compiler->ignore_case ? INST_LITERAL_STRING_IGNORE : INST_LITERAL_STRING;
+    inst->u.literal_string.s = s;
+    inst->u.literal_string.len = len;
+    inst->next = i;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+merge_literals(Compiler* compiler, Instruction* inst, Bool* changed)
+{
+    /* literals which come together by the other passes are compared at once */
+    Instruction* i = inst;
+    while (i != NULL) {
+        if ((i->type == INST_IN) || (i->type == INST_IN_IGNORE) || (i->type == INST_INFO)) {
+            /* items in a set are not instructions to run */
+            i = *get_destination(i);
+            continue;
+        }
+        if (is_literal_instruction(i) && (i->next != NULL) && is_literal_instruction(i->next)) {
+            CorgiStatus status = merge_literal_run(compiler, i);
+            if (status != CORGI_OK) {
+                return status;
+            }
+            *changed = TRUE;
+        }
+        i = i->next;
+    }
+    return CORGI_OK;
+}
+
+static CorgiStatus
+optimize_instruction(Compiler* compiler, Instruction* inst)
+{
+    /* the first instruction is INFO which no passes remove */
+    assert(inst->type == INST_INFO);
+    Bool changed = TRUE;
+    while (changed) {
+        changed = coalesce_labels(inst);
+        changed = thread_jumps(inst) || changed;
+        changed = remove_jumps_to_next(inst) || changed;
+        changed = simplify_repeats(inst) || changed;
+        changed = simplify_branches(inst) || changed;
+        changed = remove_dead_code(inst) || changed;
+        CorgiStatus status = merge_literals(compiler, inst, &changed);
+        if (status != CORGI_OK) {
+            return status;
+        }
+    }
+    return CORGI_OK;
+}
+
+static CorgiStatus nodes2instruction(Compiler*, Node*, Instruction**);
+
+static CorgiStatus
+parse_to_instruction(Compiler* compiler, CorgiChar* begin, CorgiChar* end, Instruction** inst)
+{
+    Node* node = NULL; /* gcc dislike uninitialized */
+    CorgiChar* pc = begin;
+    CorgiStatus status = parse_branch(compiler, &pc, end, &node);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    if (compiler->optimize) {
+        status = normalize_nodes(compiler, &node, FALSE);
+        if (status != CORGI_OK) {
+            return status;
+        }
+    }
+    compiler->root = node;
+    return nodes2instruction(compiler, node, inst);
+}
+
+static CorgiStatus
+nodes2instruction(Compiler* compiler, Node* node, Instruction** inst)
+{
+    /* generates a whole program from INFO to SUCCESS */
+    Instruction* info = NULL;
+    CorgiStatus status = info2instruction(compiler, node, &info);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* body = NULL;
+    status = node2instruction(compiler, node, &body);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* success = NULL;
+    status = create_instruction(compiler, INST_SUCCESS, &success);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* last = get_last_instruction(info);
+    if (body == NULL) {
+        last->next = success;
+    }
+    else {
+        last->next = body;
+        get_last_instruction(body)->next = success;
+    }
+    *inst = info;
+    if (!compiler->optimize) {
+        return CORGI_OK;
+    }
+    return optimize_instruction(compiler, info);
+}
+
+static CorgiStatus
+alloc_group(Node* node, CorgiGroup** pgroup)
+{
+    assert(node->type == NODE_SUBPATTERN);
+    if (node->u.subpattern.begin == NULL) {
+        *pgroup = NULL;
+        return CORGI_OK;
+    }
+    CorgiGroup* group = (CorgiGroup*)malloc(sizeof(CorgiGroup));
+    if (group == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    bzero(group, sizeof(*group));
+    *pgroup = group;
+    ptrdiff_t n = node->u.subpattern.end - node->u.subpattern.begin;
+    size_t size = sizeof(CorgiChar) * n;
+    CorgiChar* name = (CorgiChar*)malloc(size);
+    if (name == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    memcpy(name, node->u.subpattern.begin, size);
+    group->begin = name;
+    group->end = name + n;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+alloc_groups(Compiler* compiler, CorgiUInt groups_num, CorgiGroup*** p)
+{
+    size_t size = sizeof(CorgiGroup*) * groups_num;
+    CorgiGroup** groups = (CorgiGroup**)malloc(size);
+    if (groups == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    bzero(groups, size);
+    CorgiStatus status = CORGI_OK;
+    CorgiUInt i = 0;
+    Node* node = compiler->groups;
+    while ((node != NULL) && (status == CORGI_OK)) {
+        status = alloc_group(node, groups + groups_num - i - 1);
+        i++;
+        node = node->u.subpattern.next;
+    }
+    if (status != CORGI_OK) {
+        free_groups(groups, groups_num);
+        return status;
+    }
+    assert(i == groups_num);
+    *p = groups;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+alloc_required(Compiler* compiler, CorgiRegexp* regexp)
+{
+    CorgiUInt size = compiler->required_size;
+    if (size == 0) {
+        return CORGI_OK;
+    }
+    CorgiChar* required = (CorgiChar*)malloc(sizeof(CorgiChar) * size);
+    if (required == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    Node* node = compiler->required;
+    CorgiUInt i;
+    for (i = 0; i < size; i++) {
+        required[i] = node->u.literal.c;
+        node = node->next;
+    }
+    regexp->required = required;
+    regexp->required_size = size;
+    regexp->required_min = compiler->required_min;
+    regexp->required_max = compiler->required_max;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+compile_reverse(Compiler* compiler, CorgiRegexp* regexp)
+{
+    /* compiles a pattern ending with $ or \Z once more in reverse. this
+       reuses (and breaks) the syntax tree, so this must be the last step */
+    Node* node = compiler->root;
+    if ((node == NULL) || (node->next == NULL) || (regexp->anchor != CORGI_ANCHOR_NONE)) {
+        return CORGI_OK;
+    }
+    Node* prev;
+    for (prev = node; prev->next->next != NULL; prev = prev->next) {
+    }
+    CorgiUInt end_anchor = get_end_anchor(prev->next);
+    if (end_anchor == CORGI_ANCHOR_NONE) {
+        return CORGI_OK;
+    }
+    CorgiUInt len = 0;
+    collect_prefix(node, NULL, &len);
+    if (0 < len) {
+        /* sre_search() looks for the prefix faster */
+        return CORGI_OK;
+    }
+    prev->next = NULL;
+    Bool single_line = !can_match_linebreak(node);
+    if (!is_reversible(node) || ((regexp->max_width == CORGI_WIDTH_UNBOUNDED) && !single_line)) {
+        /* sre_search_reverse() needs a limit of the length of a match */
+        return CORGI_OK;
+    }
+    CorgiStatus status = reverse_nodes(compiler, &node);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* inst = NULL;
+    status = nodes2instruction(compiler, node, &inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    CorgiCode* code = NULL;
+    CorgiUInt code_size = 0;
+    status = instruction2code(compiler, inst, &code, &code_size);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    regexp->end_anchor = end_anchor;
+    regexp->reverse_code = code;
+    regexp->reverse_code_size = code_size;
+    regexp->single_line = single_line;
+    return CORGI_OK;
+}
+
+/* a program of an NFA, which runs without backtracking. an instruction goes
+   to x after it. SPLIT goes to both of x and y, and prefers x. REPEAT
+   remembers where an iteration of a loop starts, and UNTIL at the end of the
+   iteration goes to x when it took a character, or to y out of the loop like
+   MAX_UNTIL/MIN_UNTIL of the VM */
+enum ProgOpcode {
+    PROG_ANY,
+    PROG_ANY_ALL,
+    PROG_AT,
+    PROG_CATEGORY,
+    PROG_IN,
+    PROG_JUMP,
+    PROG_LITERAL,
+    PROG_MATCH,
+    PROG_NOT_LITERAL,
+    PROG_REPEAT,
+    PROG_SAVE,
+    PROG_SPLIT,
+    PROG_UNTIL,
+};
+
+typedef enum ProgOpcode ProgOpcode;
+
+struct ProgInst {
+    ProgOpcode op;
+    CorgiUInt x;
+    CorgiUInt y;
+    CorgiCode arg;  /* a character, a type of AT/CATEGORY, an index of a mark or of a loop */
+    CorgiCode* set; /* the code of IN/IN_IGNORE */
+};
+
+typedef struct ProgInst ProgInst;
+
+struct CorgiProg {
+    ProgInst* insts;
+    CorgiUInt size;
+    CorgiUInt capacity;
+    CorgiUInt start;    /* the first instruction of a match */
+    CorgiUInt search;   /* the first instruction of a search */
+    CorgiUInt size_max;
+    CorgiUInt loops_num;    /* loops with REPEAT */
+    CorgiUInt loops_depth;  /* the deepest nesting of the loops */
+    Bool ignore_case;
+    /* a match starts with one of the first characters, or with a character
+       of the table when firsts_num is zero. the table has all ASCII when a
+       match can start with anything */
+    CorgiChar firsts[SRE_CHARSET_CHARS_MAX];
+    CorgiUInt firsts_num;
+    unsigned char first_table[16];
+};
+
+typedef struct CorgiProg Prog;
+
+/* a pattern of a larger program gets no NFA */
+#define PROG_SIZE_MAX   10000
+/* a status only between compile_prog() and its callers */
+#define PROG_TOO_LARGE  (-1)
+
+/* kinds of the characters around a position, for AT */
+#define PROG_KIND_NONE      0   /* out of the string */
+#define PROG_KIND_LINEBREAK 1
+#define PROG_KIND_WORD      2
+#define PROG_KIND_OTHER     3
+#define PROG_KINDS_NUM      4
+
+#define PROG_KIND(ch) \
+    (SRE_IS_LINEBREAK((ch)) ? PROG_KIND_LINEBREAK : SRE_IS_WORD((ch)) ? PROG_KIND_WORD : PROG_KIND_OTHER)
+
+/* captures of a program are the marks, lastindex and the beginning of a
+   match, which are offsets from the beginning of the string or -1 */
+#define PROG_LASTINDEX(groups_num)  (2 * (groups_num))
+#define PROG_BEGIN(groups_num)      (2 * (groups_num) + 1)
+#define PROG_CAPS_NUM(groups_num)   (2 * (groups_num) + 2)
+/* the positions of REPEAT follow the captures */
+#define PROG_LOOP(groups_num, loop) (PROG_CAPS_NUM(groups_num) + (loop))
+
+/* a state of a thread is its instruction and how many loops around it are
+   in iterations which took no character yet. UNTIL of such an iteration
+   leaves the loop, so threads at an instruction go differently with
+   different numbers */
+#define PROG_STATES_NUM(prog)       ((prog)->size * ((prog)->loops_depth + 1))
+#define PROG_STATE_PC(prog, state)  ((state) / ((prog)->loops_depth + 1))
+
+static Bool
+prog_at(CorgiCode at, CorgiUInt left, CorgiUInt right)
+{
+    /* the same as sre_at() with kinds of the characters around a position */
+    switch (at) {
+    case SRE_AT_BEGINNING:
+    case SRE_AT_BEGINNING_STRING:
+        return left == PROG_KIND_NONE;
+    case SRE_AT_BEGINNING_LINE:
+        return (left == PROG_KIND_NONE) || (left == PROG_KIND_LINEBREAK);
+    case SRE_AT_END_LINE:
+        return (right == PROG_KIND_NONE) || (right == PROG_KIND_LINEBREAK);
+    case SRE_AT_END_STRING:
+        return right == PROG_KIND_NONE;
+    case SRE_AT_BOUNDARY:
+        return (left == PROG_KIND_WORD) != (right == PROG_KIND_WORD);
+    case SRE_AT_NON_BOUNDARY:
+        /* sre_at() says no in the empty string */
+        if ((left == PROG_KIND_NONE) && (right == PROG_KIND_NONE)) {
+            return FALSE;
+        }
+        return (left == PROG_KIND_WORD) == (right == PROG_KIND_WORD);
+    default:
+        return FALSE;
+    }
+}
+
+static CorgiUInt
+prog_state(Prog* prog, CorgiUInt pc, CorgiUInt empties)
+{
+    /* the number of the empty iterations is nothing to an instruction taking
+       a character or MATCH, so their threads are merged */
+    switch (prog->insts[pc].op) {
+    case PROG_AT:
+    case PROG_JUMP:
+    case PROG_REPEAT:
+    case PROG_SAVE:
+    case PROG_SPLIT:
+    case PROG_UNTIL:
+        return pc * (prog->loops_depth + 1) + empties;
+    default:
+        return pc * (prog->loops_depth + 1);
+    }
+}
+
+static Bool
+prog_test(Prog* prog, ProgInst* inst, CorgiChar c)
+{
+    /* tells whether an instruction taking a character takes c */
+    CorgiChar d = prog->ignore_case ? SRE_LOWER(c) : c;
+    switch (inst->op) {
+    case PROG_ANY:
+        return !SRE_IS_LINEBREAK(c);
+    case PROG_ANY_ALL:
+        return TRUE;
+    case PROG_CATEGORY:
+        return sre_category(inst->arg, c) ? TRUE : FALSE;
+    case PROG_IN:
+        return sre_charset(inst->set + 2, d) ? TRUE : FALSE;
+    case PROG_LITERAL:
+        return d == inst->arg;
+    case PROG_NOT_LITERAL:
+        return d != inst->arg;
+    default:
+        return FALSE;
+    }
+}
+
+static void
+prog_compute_firsts(Prog* prog, CorgiUInt* stack, CorgiUInt* sparse, CorgiUInt* dense)
+{
+    /* collects the characters which the instructions at the beginning of a
+       match take. AT is passed because the characters around are unknown */
+    memset(prog->first_table, 0xff, sizeof(prog->first_table));
+    unsigned char table[16];
+    bzero(table, sizeof(table));
+    Bool literals = !prog->ignore_case;
+    CorgiUInt firsts_num = 0;
+    CorgiUInt visited = 0;
+    CorgiUInt sp = 0;
+    stack[sp] = prog->start;
+    sp++;
+    while (0 < sp) {
+        sp--;
+        CorgiUInt pc = stack[sp];
+        if ((sparse[pc] < visited) && (dense[sparse[pc]] == pc)) {
+            continue;
+        }
+        sparse[pc] = visited;
+        dense[visited] = pc;
+        visited++;
+        ProgInst* inst = &prog->insts[pc];
+        CorgiChar c;
+        switch (inst->op) {
+        case PROG_AT:
+        case PROG_JUMP:
+        case PROG_REPEAT:
+        case PROG_SAVE:
+            stack[sp] = inst->x;
+            sp++;
+            continue;
+        case PROG_SPLIT:
+        case PROG_UNTIL:
+            stack[sp] = inst->y;
+            stack[sp + 1] = inst->x;
+            sp += 2;
+            continue;
+        case PROG_MATCH:
+            /* an empty match can be anywhere */
+            return;
+        case PROG_LITERAL:
+            c = 0;
+            while ((c < firsts_num) && (prog->firsts[c] != inst->arg)) {
+                c++;
+            }
+            if ((c == firsts_num) && (firsts_num < SRE_CHARSET_CHARS_MAX)) {
+                prog->firsts[firsts_num] = inst->arg;
+                firsts_num++;
+            }
+            else if (c == firsts_num) {
+                literals = FALSE;
+            }
+            break;
+        default:
+            literals = FALSE;
+            break;
+        }
+        for (c = 0; c < 128; c++) {
+            if (prog_test(prog, inst, c)) {
+                table[c & 15] |= 1 << (c >> 4);
+            }
+        }
+    }
+    prog->firsts_num = literals ? firsts_num : 0;
+    memcpy(prog->first_table, table, sizeof(table));
+}
+
+static Bool
+is_all_ascii(unsigned char* table)
+{
+    CorgiUInt i;
+    for (i = 0; i < 16; i++) {
+        if (table[i] != 0xff) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static CorgiChar*
+prog_skip(Prog* prog, CorgiRegexp* regexp, CorgiChar* ptr, CorgiChar* end, CorgiChar** found)
+{
+    /* returns the first position from ptr where a match can start, or NULL.
+       a match starts in the window before an occurrence of the required
+       literal like sre_search_required(), and with one of the first
+       characters. regexp may be NULL */
+    if ((regexp != NULL) && (regexp->required != NULL)) {
+        CorgiUInt min = regexp->required_min;
+        if ((*found == NULL) || (*found - ptr < (ptrdiff_t)min)) {
+            if ((CorgiUInt)(end - ptr) < min) {
+                return NULL;
+            }
+            *found = find_literal(ptr + min, end, regexp->required, regexp->required_size);
+            if (*found == NULL) {
+                return NULL;
+            }
+        }
+        CorgiUInt max = regexp->required_max;
+        if (max < (CorgiUInt)(*found - ptr)) {
+            ptr = *found - max;
+        }
+    }
+    if (0 < prog->firsts_num) {
+        ptr = corgi_find_chars(ptr, end, prog->firsts, prog->firsts_num);
+    }
+    else if (!is_all_ascii(prog->first_table)) {
+        ptr = corgi_find_ascii(ptr, end, prog->first_table);
+    }
+    return ptr < end ? ptr : NULL;
+}
+
+static void
+fini_prog(Prog* prog)
+{
+    CorgiUInt i;
+    for (i = 0; i < prog->size; i++) {
+        free(prog->insts[i].set);
+    }
+    free(prog->insts);
+}
+
+static void
+free_prog(Prog* prog)
+{
+    if (prog == NULL) {
+        return;
+    }
+    fini_prog(prog);
+    free(prog);
+}
+
+static CorgiStatus
+prog_add(Prog* prog, ProgOpcode op, CorgiCode arg, CorgiUInt* pc)
+{
+    if (prog->size_max <= prog->size) {
+        return PROG_TOO_LARGE;
+    }
+    if (prog->size == prog->capacity) {
+        CorgiUInt capacity = prog->capacity == 0 ? 64 : 2 * prog->capacity;
+        ProgInst* insts = (ProgInst*)realloc(prog->insts, sizeof(ProgInst) * capacity);
+        if (insts == NULL) {
+            return ERR_OUT_OF_MEMORY;
+        }
+        prog->insts = insts;
+        prog->capacity = capacity;
+    }
+    CorgiUInt n = prog->size;
+    ProgInst* inst = &prog->insts[n];
+    inst->op = op;
+    inst->x = n + 1;
+    inst->y = 0;
+    inst->arg = arg;
+    inst->set = NULL;
+    prog->size++;
+    if (pc != NULL) {
+        *pc = n;
+    }
+    return CORGI_OK;
+}
+
+static void
+prog_set_split(Prog* prog, CorgiUInt pc, CorgiUInt body, CorgiUInt out, Bool greedy)
+{
+    prog->insts[pc].x = greedy ? body : out;
+    prog->insts[pc].y = greedy ? out : body;
+}
+
+static CorgiStatus
+prog_add_in(Compiler* compiler, Prog* prog, Node* node)
+{
+    CorgiUInt pc;
+    CorgiStatus status = prog_add(prog, PROG_IN, 0, &pc);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    Instruction* inst = NULL;
+    status = in2instruction(compiler, node, &inst);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    CorgiCode* code = NULL;
+    CorgiUInt code_size = 0;
+    status = instruction2code(compiler, inst, &code, &code_size);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    prog->insts[pc].set = code;
+    return CORGI_OK;
+}
+
+static CorgiStatus prog_add_nodes(Compiler*, Prog*, Node*, Bool);
+
+static CorgiStatus
+prog_add_branch(Compiler* compiler, Prog* prog, Node* node, Bool reverse)
+{
+    /* SPLIT L1, L2; L1: left; JUMP out; L2: right; out: */
+    CorgiUInt split;
+    CorgiStatus status = prog_add(prog, PROG_SPLIT, 0, &split);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    status = prog_add_nodes(compiler, prog, node->u.branch.left, reverse);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    CorgiUInt jump;
+    status = prog_add(prog, PROG_JUMP, 0, &jump);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    prog_set_split(prog, split, split + 1, prog->size, TRUE);
+    Node* right = node->u.branch.right;
+    if ((right == NULL) || (right->type != NODE_BRANCH)) {
+        status = prog_add_nodes(compiler, prog, right, reverse);
+    }
+    else {
+        status = prog_add_branch(compiler, prog, right, reverse);
+    }
+    if (status != CORGI_OK) {
+        return status;
+    }
+    prog->insts[jump].x = prog->size;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+prog_add_iteration(Compiler* compiler, Prog* prog, Node* body, CorgiInt loop, Bool reverse)
+{
+    /* adds an optional iteration of a body. when the body can match an empty
+       string, the iteration is REPEAT loop; body; UNTIL loop, and y of UNTIL
+       is set when the end of the loop is known */
+    if (loop < 0) {
+        return prog_add_nodes(compiler, prog, body, reverse);
+    }
+    CorgiStatus status = prog_add(prog, PROG_REPEAT, loop, NULL);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    status = prog_add_nodes(compiler, prog, body, reverse);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    return prog_add(prog, PROG_UNTIL, loop, NULL);
+}
+
+static CorgiStatus
+prog_add_repeat(Compiler* compiler, Prog* prog, Node* node, Bool reverse)
+{
+    Node* body = node->u.repeat.body;
+    Bool greedy = node->type == NODE_MAX_REPEAT;
+    CorgiUInt min = node->u.repeat.min;
+    CorgiUInt max = node->u.repeat.max;
+    CorgiStatus status;
+    CorgiUInt i;
+    for (i = 0; i < min; i++) {
+        status = prog_add_nodes(compiler, prog, body, reverse);
+        if (status != CORGI_OK) {
+            return status;
+        }
+    }
+    /* the VM leaves a loop after an optional iteration which took no
+       character. the last iteration of a bounded loop needs no check */
+    CorgiUInt width_min;
+    CorgiUInt width_max;
+    compute_width(body, &width_min, &width_max);
+    CorgiInt loop = -1;
+    if ((width_min == 0) && (min + 1 < max)) {
+        loop = prog->loops_num;
+        prog->loops_num++;
+    }
+    CorgiUInt begin = prog->size;
+    CorgiUInt split;
+    if (max == 65535) {
+        /* L: SPLIT body, out; body: ...; JUMP L; out:. UNTIL goes to L
+           instead of JUMP */
+        status = prog_add(prog, PROG_SPLIT, 0, &split);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        status = prog_add_iteration(compiler, prog, body, loop, reverse);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        if (loop < 0) {
+            status = prog_add(prog, PROG_JUMP, 0, NULL);
+            if (status != CORGI_OK) {
+                return status;
+            }
+        }
+        prog->insts[prog->size - 1].x = split;
+        prog_set_split(prog, split, split + 1, prog->size, greedy);
+    }
+    else {
+        /* each optional body is SPLIT body, out; body: .... the splits are
+           chained with their y until out is known */
+        CorgiUInt last = prog->size;
+        for (i = min; i < max; i++) {
+            status = prog_add(prog, PROG_SPLIT, 0, &split);
+            if (status != CORGI_OK) {
+                return status;
+            }
+            prog->insts[split].y = last;
+            last = split;
+            status = prog_add_iteration(compiler, prog, body, i + 1 < max ? loop : -1, reverse);
+            if (status != CORGI_OK) {
+                return status;
+            }
+        }
+        CorgiUInt out = prog->size;
+        for (i = min; i < max; i++) {
+            CorgiUInt prev = prog->insts[last].y;
+            prog_set_split(prog, last, last + 1, out, greedy);
+            last = prev;
+        }
+    }
+    CorgiUInt pc;
+    for (pc = begin; (0 <= loop) && (pc < prog->size); pc++) {
+        ProgInst* inst = &prog->insts[pc];
+        if ((inst->op == PROG_UNTIL) && (inst->arg == (CorgiCode)loop)) {
+            inst->y = prog->size;
+        }
+    }
+    return CORGI_OK;
+}
+
+static CorgiStatus
+prog_add_subpattern(Compiler* compiler, Prog* prog, Node* node, Bool reverse)
+{
+    Node* body = node->u.subpattern.node;
+    if (!node->u.subpattern.capture) {
+        return prog_add_nodes(compiler, prog, body, reverse);
+    }
+    CorgiUInt mark = 2 * node->u.subpattern.group_id;
+    CorgiStatus status = prog_add(prog, PROG_SAVE, reverse ? mark + 1 : mark, NULL);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    status = prog_add_nodes(compiler, prog, body, reverse);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    return prog_add(prog, PROG_SAVE, reverse ? mark : mark + 1, NULL);
+}
+
+static CorgiStatus
+prog_add_node(Compiler* compiler, Prog* prog, Node* node, Bool reverse)
+{
+    CorgiChar c;
+    switch (node->type) {
+    case NODE_ANY:
+        return prog_add(prog, PROG_ANY, 0, NULL);
+    case NODE_AT:
+        return prog_add(prog, PROG_AT, node->u.at.type, NULL);
+    case NODE_BRANCH:
+        return prog_add_branch(compiler, prog, node, reverse);
+    case NODE_CATEGORY:
+        return prog_add(prog, PROG_CATEGORY, node->u.category.type, NULL);
+    case NODE_IN:
+        return prog_add_in(compiler, prog, node);
+    case NODE_LITERAL:
+    case NODE_NOT_LITERAL:
+        c = node->u.literal.c;
+        c = compiler->ignore_case ? corgi_tolower(c) : c;
+        return prog_add(prog, node->type == NODE_LITERAL ? PROG_LITERAL : PROG_NOT_LITERAL, c, NULL);
+    case NODE_MAX_REPEAT:
+    case NODE_MIN_REPEAT:
+        return prog_add_repeat(compiler, prog, node, reverse);
+    case NODE_SUBPATTERN:
+        return prog_add_subpattern(compiler, prog, node, reverse);
+    default:
+        return ERR_INVALID_NODE;
+    }
+}
+
+static CorgiStatus
+prog_add_nodes(Compiler* compiler, Prog* prog, Node* node, Bool reverse)
+{
+    CorgiStatus status;
+    Node* n;
+    if (!reverse) {
+        for (n = node; n != NULL; n = n->next) {
+            status = prog_add_node(compiler, prog, n, reverse);
+            if (status != CORGI_OK) {
+                return status;
+            }
+        }
+        return CORGI_OK;
+    }
+    CorgiUInt size = 0;
+    for (n = node; n != NULL; n = n->next) {
+        size++;
+    }
+    Node** nodes = (Node**)alloc(compiler, sizeof(Node*) * size);
+    if (nodes == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiUInt i = 0;
+    for (n = node; n != NULL; n = n->next) {
+        nodes[i] = n;
+        i++;
+    }
+    while (0 < i) {
+        i--;
+        status = prog_add_node(compiler, prog, nodes[i], reverse);
+        if (status != CORGI_OK) {
+            return status;
+        }
+    }
+    return CORGI_OK;
+}
+
+static CorgiStatus
+prog_add_search(Prog* prog)
+{
+    /* a search tries the later positions with lower priority.
+       L: SPLIT start, A; A: ANY_ALL; (to L) */
+    CorgiUInt search;
+    CorgiStatus status = prog_add(prog, PROG_SPLIT, 0, &search);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    prog_set_split(prog, search, prog->start, search + 1, TRUE);
+    CorgiUInt any;
+    status = prog_add(prog, PROG_ANY_ALL, 0, &any);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    prog->insts[any].x = search;
+    prog->search = search;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+prog_find_firsts(Prog* prog)
+{
+    CorgiStatus status = CORGI_OK;
+    CorgiUInt size = prog->size;
+    CorgiUInt* stack = (CorgiUInt*)malloc(sizeof(CorgiUInt) * (2 * size + 1));
+    CorgiUInt* sparse = (CorgiUInt*)calloc(size, sizeof(CorgiUInt));
+    CorgiUInt* dense = (CorgiUInt*)malloc(sizeof(CorgiUInt) * size);
+    if ((stack != NULL) && (sparse != NULL) && (dense != NULL)) {
+        prog_compute_firsts(prog, stack, sparse, dense);
+    }
+    else {
+        status = ERR_OUT_OF_MEMORY;
+    }
+    free(dense);
+    free(sparse);
+    free(stack);
+    return status;
+}
+
+static void
+prog_find_loops_depth(Prog* prog)
+{
+    /* the body of a loop is between its REPEAT and UNTIL, so the loops nest
+       in the order of the instructions */
+    CorgiUInt depth = 0;
+    CorgiUInt pc;
+    for (pc = 0; pc < prog->size; pc++) {
+        switch (prog->insts[pc].op) {
+        case PROG_REPEAT:
+            depth++;
+            if (prog->loops_depth < depth) {
+                prog->loops_depth = depth;
+            }
+            break;
+        case PROG_UNTIL:
+            depth--;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static CorgiStatus
+compile_prog(Compiler* compiler, Node* node, Bool reverse, Prog* prog)
+{
+    /* compiles the syntax tree to a program. a reversed program matches the
+       reversed strings */
+    bzero(prog, sizeof(*prog));
+    prog->size_max = PROG_SIZE_MAX;
+    prog->ignore_case = compiler->ignore_case;
+    CorgiStatus status = prog_add_nodes(compiler, prog, node, reverse);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    status = prog_add(prog, PROG_MATCH, 0, NULL);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    status = prog_add_search(prog);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    prog_find_loops_depth(prog);
+    if (reverse) {
+        return CORGI_OK;
+    }
+    return prog_find_firsts(prog);
+}
+
+static Bool
+is_prog_node(Node* node)
+{
+    /* tells whether a program of the node sequence matches just like the VM */
+    Node* n;
+    for (n = node; n != NULL; n = n->next) {
+        switch (n->type) {
+        case NODE_ANY:
+        case NODE_CATEGORY:
+        case NODE_IN:
+        case NODE_LITERAL:
+        case NODE_NOT_LITERAL:
+            break;
+        case NODE_AT:
+            switch (n->u.at.type) {
+            case SRE_AT_BEGINNING:
+            case SRE_AT_BEGINNING_LINE:
+            case SRE_AT_BEGINNING_STRING:
+            case SRE_AT_BOUNDARY:
+            case SRE_AT_END_LINE:
+            case SRE_AT_END_STRING:
+            case SRE_AT_NON_BOUNDARY:
+                break;
+            default:
+                return FALSE;
+            }
+            break;
+        case NODE_BRANCH:
+            if (!is_prog_node(n->u.branch.left) || !is_prog_node(n->u.branch.right)) {
+                return FALSE;
+            }
+            break;
+        case NODE_MAX_REPEAT:
+        case NODE_MIN_REPEAT:
+            if (!is_prog_node(n->u.repeat.body)) {
+                return FALSE;
+            }
+            break;
+        case NODE_SUBPATTERN:
+            if (!is_prog_node(n->u.subpattern.node)) {
+                return FALSE;
+            }
+            break;
+        case NODE_ATOMIC_GROUP:
+        case NODE_POSSESSIVE_REPEAT:
+        default:
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* a state of a lazy DFA is a list of threads of a program. states are made
+   when a search needs them, and are remembered in a cache until it is
+   full */
+struct DfaState {
+    struct DfaState* hash_next;
+    CorgiUInt hash;
+    CorgiUInt kind;     /* of the last character */
+    Bool match;         /* a match ends before the last character */
+    Bool start;         /* only the thread which tries the next position */
+    Bool special;       /* a match, the start or no threads */
+    CorgiUInt size;
+    CorgiUInt* pcs;     /* the threads in priority order */
+    struct DfaState** next; /* the states after the classes of ASCII */
+};
+
+typedef struct DfaState DfaState;
+
+/* the threads after a character */
+struct DfaStep {
+    CorgiUInt size;
+    CorgiUInt pcs[0];
+};
+
+typedef struct DfaStep DfaStep;
+
+#define DFA_BUCKETS_NUM 1024
+#define DFA_CACHE_SIZE  (1024 * 1024)
+
+struct Dfa {
+    Prog prog;
+    /* a forward DFA stops the threads of lower priority than a match. a
+       reverse one runs all of them for the longest match */
+    Bool reverse;
+    /* a DFA of a set runs all threads too, and its states keep the matches
+       of the patterns. see dfa_step() */
+    Bool set;
+    unsigned char classes[128]; /* ASCII characters of a class go the same way */
+    CorgiUInt classes_num;
+    struct DfaState* buckets[DFA_BUCKETS_NUM];
+    struct DfaState* starts[PROG_KINDS_NUM][2];
+    /* the threads which the search thread of a set makes with each class
+       after each kind, which all states of a set share */
+    struct DfaStep* search_steps[PROG_KINDS_NUM][128];
+    CorgiUInt cache_size;
+    CorgiUInt cache_max;
+    /* work areas as large as the program */
+    CorgiUInt* stack;
+    CorgiUInt* sparse;
+    CorgiUInt* dense;
+    CorgiUInt* list;
+    CorgiUInt* pcs;
+    CorgiUInt* saved;
+};
+
+typedef struct Dfa Dfa;
+
+struct CorgiDfa {
+    struct Dfa forward;
+    struct Dfa backward;    /* finds the beginning of a match from its end */
+};
+
+typedef struct CorgiDfa CorgiDfa;
+
+static void
+dfa_refine_classes(Dfa* dfa, ProgInst* inst)
+{
+    /* splits each class into the characters which the instruction takes and
+       the others */
+    unsigned char ids[128][2];
+    memset(ids, 0xff, sizeof(ids));
+    CorgiUInt num = 0;
+    CorgiChar c;
+    for (c = 0; c < 128; c++) {
+        Bool b = inst != NULL ? prog_test(&dfa->prog, inst, c) : FALSE;
+        unsigned char* id = &ids[dfa->classes[c]][b ? 1 : 0];
+        if (*id == 0xff) {
+            *id = num;
+            num++;
+        }
+        dfa->classes[c] = *id;
+    }
+    dfa->classes_num = num;
+}
+
+static void
+dfa_compute_classes(Dfa* dfa)
+{
+    CorgiChar c;
+    for (c = 0; c < 128; c++) {
+        dfa->classes[c] = PROG_KIND(c);
+    }
+    dfa_refine_classes(dfa, NULL);
+    CorgiUInt i;
+    for (i = 0; i < dfa->prog.size; i++) {
+        ProgInst* inst = &dfa->prog.insts[i];
+        switch (inst->op) {
+        case PROG_ANY:
+        case PROG_CATEGORY:
+        case PROG_IN:
+        case PROG_LITERAL:
+        case PROG_NOT_LITERAL:
+            dfa_refine_classes(dfa, inst);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static CorgiStatus
+init_dfa(Dfa* dfa, Bool reverse)
+{
+    dfa->reverse = reverse;
+    dfa->cache_max = DFA_CACHE_SIZE;
+    CorgiUInt size = dfa->prog.size;
+    /* a state of a set has the threads and the matches, which are two lists
+       before they are merged */
+    CorgiUInt pcs_max = dfa->set ? 2 * size : size;
+    /* a thread pushes at most two instructions */
+    dfa->stack = (CorgiUInt*)malloc(sizeof(CorgiUInt) * (2 * size + 1));
+    dfa->sparse = (CorgiUInt*)calloc(size, sizeof(CorgiUInt));
+    dfa->dense = (CorgiUInt*)malloc(sizeof(CorgiUInt) * size);
+    dfa->list = (CorgiUInt*)malloc(sizeof(CorgiUInt) * size);
+    dfa->pcs = (CorgiUInt*)malloc(sizeof(CorgiUInt) * pcs_max);
+    dfa->saved = (CorgiUInt*)malloc(sizeof(CorgiUInt) * pcs_max);
+    if ((dfa->stack == NULL) || (dfa->sparse == NULL) || (dfa->dense == NULL) || (dfa->list == NULL) || (dfa->pcs == NULL) || (dfa->saved == NULL)) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    dfa_compute_classes(dfa);
+    return CORGI_OK;
+}
+
+static void
+dfa_flush(Dfa* dfa)
+{
+    CorgiUInt i;
+    for (i = 0; i < DFA_BUCKETS_NUM; i++) {
+        DfaState* state = dfa->buckets[i];
+        while (state != NULL) {
+            DfaState* next = state->hash_next;
+            free(state);
+            state = next;
+        }
+    }
+    bzero(dfa->buckets, sizeof(dfa->buckets));
+    bzero(dfa->starts, sizeof(dfa->starts));
+    CorgiUInt j;
+    for (i = 0; i < PROG_KINDS_NUM; i++) {
+        for (j = 0; j < 128; j++) {
+            free(dfa->search_steps[i][j]);
+        }
+    }
+    bzero(dfa->search_steps, sizeof(dfa->search_steps));
+    dfa->cache_size = 0;
+}
+
+static void
+fini_dfa(Dfa* dfa)
+{
+    dfa_flush(dfa);
+    free(dfa->saved);
+    free(dfa->pcs);
+    free(dfa->list);
+    free(dfa->dense);
+    free(dfa->sparse);
+    free(dfa->stack);
+    fini_prog(&dfa->prog);
+}
+
+static void
+free_dfa(CorgiDfa* dfa)
+{
+    if (dfa == NULL) {
+        return;
+    }
+    fini_dfa(&dfa->forward);
+    fini_dfa(&dfa->backward);
+    free(dfa);
+}
+
+static Bool
+dfa_closure(Dfa* dfa, CorgiUInt* pcs, CorgiUInt size, CorgiUInt left, CorgiUInt right, CorgiUInt* list_size)
+{
+    /* follows the instructions which take no character from the threads in
+       priority order. the list gets the instructions which take a character,
+       and MATCH of a set. returns TRUE when a thread matches */
+    ProgInst* insts = dfa->prog.insts;
+    CorgiUInt* stack = dfa->stack;
+    CorgiUInt* sparse = dfa->sparse;
+    CorgiUInt* dense = dfa->dense;
+    CorgiUInt visited = 0;
+    CorgiUInt n = 0;
+    Bool match = FALSE;
+    CorgiUInt i;
+    for (i = 0; i < size; i++) {
+        if (dfa->prog.size <= pcs[i]) {
+            /* a match of a set which a state keeps */
+            continue;
+        }
+        CorgiUInt sp = 0;
+        stack[sp] = pcs[i];
+        sp++;
+        while (0 < sp) {
+            sp--;
+            CorgiUInt pc = stack[sp];
+            if ((sparse[pc] < visited) && (dense[sparse[pc]] == pc)) {
+                continue;
+            }
+            sparse[pc] = visited;
+            dense[visited] = pc;
+            visited++;
+            ProgInst* inst = &insts[pc];
+            switch (inst->op) {
+            case PROG_AT:
+                if (prog_at(inst->arg, left, right)) {
+                    stack[sp] = inst->x;
+                    sp++;
+                }
+                break;
+            case PROG_JUMP:
+            case PROG_REPEAT:
+            case PROG_SAVE:
+                stack[sp] = inst->x;
+                sp++;
+                break;
+            case PROG_SPLIT:
+            case PROG_UNTIL:
+                /* UNTIL after an empty iteration comes back to the loop,
+                   which is in the list already */
+                stack[sp] = inst->y;
+                stack[sp + 1] = inst->x;
+                sp += 2;
+                break;
+            case PROG_MATCH:
+                match = TRUE;
+                if (dfa->set) {
+                    dfa->list[n] = pc;
+                    n++;
+                }
+                else if (!dfa->reverse) {
+                    /* the threads after this lose to this match */
+                    *list_size = n;
+                    return TRUE;
+                }
+                break;
+            default:
+                dfa->list[n] = pc;
+                n++;
+                break;
+            }
+        }
+    }
+    *list_size = n;
+    return match;
+}
+
+#define DFA_STATE_SIZE(dfa, size) \
+    (sizeof(DfaState) + sizeof(DfaState*) * (dfa)->classes_num + sizeof(CorgiUInt) * (size))
+
+static CorgiUInt
+dfa_hash(CorgiUInt kind, Bool match, CorgiUInt* pcs, CorgiUInt size)
+{
+    CorgiUInt hash = 2 * kind + (match ? 1 : 0);
+    CorgiUInt i;
+    for (i = 0; i < size; i++) {
+        hash = 31 * hash + pcs[i];
+    }
+    return hash;
+}
+
+static DfaState*
+dfa_find_state(Dfa* dfa, CorgiUInt hash, CorgiUInt kind, Bool match, CorgiUInt* pcs, CorgiUInt size)
+{
+    DfaState* state;
+    for (state = dfa->buckets[hash % DFA_BUCKETS_NUM]; state != NULL; state = state->hash_next) {
+        if ((state->hash == hash) && (state->kind == kind) && (state->match == match) && (state->size == size) && (memcmp(state->pcs, pcs, sizeof(CorgiUInt) * size) == 0)) {
+            return state;
+        }
+    }
+    return NULL;
+}
+
+static DfaState*
+dfa_new_state(Dfa* dfa, CorgiUInt hash, CorgiUInt kind, Bool match, CorgiUInt* pcs, CorgiUInt size)
+{
+    CorgiUInt bytes = DFA_STATE_SIZE(dfa, size);
+    DfaState* state = (DfaState*)malloc(bytes);
+    if (state == NULL) {
+        return NULL;
+    }
+    state->hash = hash;
+    state->kind = kind;
+    state->match = match;
+    state->start = (size == 1) && (pcs[0] == dfa->prog.search);
+    state->special = match || state->start || (size == 0);
+    state->size = size;
+    state->next = (DfaState**)(state + 1);
+    bzero(state->next, sizeof(DfaState*) * dfa->classes_num);
+    state->pcs = (CorgiUInt*)(state->next + dfa->classes_num);
+    memcpy(state->pcs, pcs, sizeof(CorgiUInt) * size);
+    DfaState** bucket = &dfa->buckets[hash % DFA_BUCKETS_NUM];
+    state->hash_next = *bucket;
+    *bucket = state;
+    dfa->cache_size += bytes;
+    return state;
+}
+
+static DfaState*
+dfa_add_state(Dfa* dfa, CorgiUInt kind, Bool match, CorgiUInt* pcs, CorgiUInt size, DfaState** current)
+{
+    /* returns the state of the threads. a full cache is flushed, and then
+       the current state is made again */
+    CorgiUInt hash = dfa_hash(kind, match, pcs, size);
+    DfaState* state = dfa_find_state(dfa, hash, kind, match, pcs, size);
+    if (state != NULL) {
+        return state;
+    }
+    if (dfa->cache_max < dfa->cache_size + DFA_STATE_SIZE(dfa, size)) {
+        DfaState* cur = current != NULL ? *current : NULL;
+        if (cur == NULL) {
+            dfa_flush(dfa);
+            return dfa_new_state(dfa, hash, kind, match, pcs, size);
+        }
+        CorgiUInt cur_kind = cur->kind;
+        Bool cur_match = cur->match;
+        CorgiUInt cur_size = cur->size;
+        memcpy(dfa->saved, cur->pcs, sizeof(CorgiUInt) * cur_size);
+        dfa_flush(dfa);
+        CorgiUInt cur_hash = dfa_hash(cur_kind, cur_match, dfa->saved, cur_size);
+        *current = dfa_new_state(dfa, cur_hash, cur_kind, cur_match, dfa->saved, cur_size);
+        if (*current == NULL) {
+            return NULL;
+        }
+        state = dfa_find_state(dfa, hash, kind, match, pcs, size);
+        if (state != NULL) {
+            return state;
+        }
+    }
+    return dfa_new_state(dfa, hash, kind, match, pcs, size);
+}
+
+static DfaState*
+dfa_start(Dfa* dfa, CorgiUInt kind, Bool anchored)
+{
+    DfaState** start = &dfa->starts[kind][anchored ? 1 : 0];
+    if (*start != NULL) {
+        return *start;
+    }
+    CorgiUInt pc = anchored ? dfa->prog.start : dfa->prog.search;
+    DfaState* state = dfa_add_state(dfa, kind, FALSE, &pc, 1, NULL);
+    *start = state;
+    return state;
+}
+
+static CorgiUInt
+dfa_step(Dfa* dfa, CorgiUInt n, CorgiChar c, CorgiUInt* pcs)
+{
+    /* puts the threads after c from the list of a closure to pcs, and
+       returns their number */
+    CorgiUInt size = 0;
+    CorgiUInt i;
+    for (i = 0; i < n; i++) {
+        ProgInst* inst = &dfa->prog.insts[dfa->list[i]];
+        if (prog_test(&dfa->prog, inst, c)) {
+            pcs[size] = inst->x;
+            size++;
+        }
+    }
+    /* the next state of a set keeps the matches before c at the end of the
+       threads as MATCH plus the size of the program, which no thread runs */
+    for (i = 0; dfa->set && (i < n); i++) {
+        CorgiUInt pc = dfa->list[i];
+        if (dfa->prog.insts[pc].op == PROG_MATCH) {
+            pcs[size] = dfa->prog.size + pc;
+            size++;
+        }
+    }
+    return size;
+}
+
+static DfaStep*
+dfa_search_step(Dfa* dfa, CorgiUInt left, CorgiChar c)
+{
+    DfaStep** step = &dfa->search_steps[left][dfa->classes[c]];
+    if (*step != NULL) {
+        return *step;
+    }
+    CorgiUInt search = dfa->prog.search;
+    CorgiUInt n;
+    dfa_closure(dfa, &search, 1, left, PROG_KIND(c), &n);
+    CorgiUInt bytes = sizeof(DfaStep) + sizeof(CorgiUInt) * n;
+    DfaStep* new_step = (DfaStep*)malloc(bytes);
+    if (new_step == NULL) {
+        return NULL;
+    }
+    new_step->size = dfa_step(dfa, n, c, new_step->pcs);
+    *step = new_step;
+    dfa->cache_size += bytes;
+    return new_step;
+}
+
+static int
+compare_pcs(const void* a, const void* b)
+{
+    CorgiUInt x = *(const CorgiUInt*)a;
+    CorgiUInt y = *(const CorgiUInt*)b;
+    return x < y ? -1 : y < x ? 1 : 0;
+}
+
+static DfaState*
+dfa_next_set(Dfa* dfa, DfaState** current, CorgiChar c)
+{
+    /* the closure of the search thread reaches all patterns of a set, so it
+       is stepped once for each class. the threads of a set are sorted and
+       unique because their order does not matter */
+    DfaState* state = *current;
+    DfaStep* step = dfa_search_step(dfa, state->kind, c);
+    if (step == NULL) {
+        return NULL;
+    }
+    CorgiUInt search = dfa->prog.search;
+    CorgiUInt size = 0;
+    CorgiUInt i;
+    for (i = 0; i < state->size; i++) {
+        if (state->pcs[i] != search) {
+            dfa->saved[size] = state->pcs[i];
+            size++;
+        }
+    }
+    CorgiUInt kind = PROG_KIND(c);
+    CorgiUInt n;
+    dfa_closure(dfa, dfa->saved, size, state->kind, kind, &n);
+    size = dfa_step(dfa, n, c, dfa->pcs);
+    memcpy(dfa->pcs + size, step->pcs, sizeof(CorgiUInt) * step->size);
+    size += step->size;
+    qsort(dfa->pcs, size, sizeof(CorgiUInt), compare_pcs);
+    CorgiUInt m = 0;
+    for (i = 0; i < size; i++) {
+        if ((m == 0) || (dfa->pcs[m - 1] != dfa->pcs[i])) {
+            dfa->pcs[m] = dfa->pcs[i];
+            m++;
+        }
+    }
+    Bool match = (0 < m) && (dfa->prog.size <= dfa->pcs[m - 1]);
+    DfaState* next = dfa_add_state(dfa, kind, match, dfa->pcs, m, current);
+    if (next != NULL) {
+        (*current)->next[dfa->classes[c]] = next;
+    }
+    return next;
+}
+
+static DfaState*
+dfa_next(Dfa* dfa, DfaState** current, CorgiChar c)
+{
+    /* makes the state after c, which the current state remembers when c is
+       ASCII */
+    if (dfa->set && (c < 128)) {
+        return dfa_next_set(dfa, current, c);
+    }
+    DfaState* state = *current;
+    CorgiUInt kind = PROG_KIND(c);
+    CorgiUInt left = dfa->reverse ? kind : state->kind;
+    CorgiUInt right = dfa->reverse ? state->kind : kind;
+    CorgiUInt n;
+    Bool match = dfa_closure(dfa, state->pcs, state->size, left, right, &n);
+    CorgiUInt size = dfa_step(dfa, n, c, dfa->pcs);
+    DfaState* next = dfa_add_state(dfa, kind, match, dfa->pcs, size, current);
+    if ((next != NULL) && (c < 128)) {
+        (*current)->next[dfa->classes[c]] = next;
+    }
+    return next;
+}
+
+static CorgiStatus
+dfa_search_forward(Dfa* dfa, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end, CorgiChar* at, Bool anchored, CorgiChar** match_end)
+{
+    /* runs the DFA from at to the end of the leftmost match of the highest
+       priority. *match_end is NULL when there is no match */
+    *match_end = NULL;
+    DfaState* state = dfa_start(dfa, begin < at ? PROG_KIND(at[-1]) : PROG_KIND_NONE, anchored);
+    if (state == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiChar* found = NULL;
+    CorgiChar* ptr = at;
+    while (ptr < end) {
+        if (state->special) {
+            if (state->match) {
+                *match_end = ptr - 1;
+            }
+            if (state->size == 0) {
+                return CORGI_OK;
+            }
+            if (state->start) {
+                /* no thread is running. the DFA goes to where a match can
+                   start */
+                CorgiChar* p = prog_skip(&dfa->prog, regexp, ptr, end, &found);
+                if (p == NULL) {
+                    return CORGI_OK;
+                }
+                if (p != ptr) {
+                    ptr = p;
+                    state = dfa_start(dfa, PROG_KIND(ptr[-1]), FALSE);
+                    if (state == NULL) {
+                        return ERR_OUT_OF_MEMORY;
+                    }
+                }
+            }
+        }
+        CorgiChar c = *ptr;
+        DfaState* next = c < 128 ? state->next[dfa->classes[c]] : NULL;
+        if (next == NULL) {
+            next = dfa_next(dfa, &state, c);
+            if (next == NULL) {
+                return ERR_OUT_OF_MEMORY;
+            }
+        }
+        state = next;
+        ptr++;
+    }
+    if (state->match) {
+        *match_end = ptr - 1;
+    }
+    CorgiUInt n;
+    if (dfa_closure(dfa, state->pcs, state->size, state->kind, PROG_KIND_NONE, &n)) {
+        *match_end = end;
+    }
+    return CORGI_OK;
+}
+
+static CorgiStatus
+dfa_search_backward(Dfa* dfa, CorgiChar* begin, CorgiChar* end, CorgiChar* at, CorgiChar* match_end, CorgiChar** match_begin)
+{
+    /* runs the reverse DFA from the end of a match back to at. the longest
+       match in reverse starts at the leftmost position */
+    *match_begin = NULL;
+    DfaState* state = dfa_start(dfa, match_end < end ? PROG_KIND(*match_end) : PROG_KIND_NONE, TRUE);
+    if (state == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiChar* ptr;
+    for (ptr = match_end; at < ptr; ptr--) {
+        CorgiChar c = ptr[-1];
+        DfaState* next = c < 128 ? state->next[dfa->classes[c]] : NULL;
+        if (next == NULL) {
+            next = dfa_next(dfa, &state, c);
+            if (next == NULL) {
+                return ERR_OUT_OF_MEMORY;
+            }
+        }
+        state = next;
+        if (state->match) {
+            *match_begin = ptr;
+        }
+        if (state->size == 0) {
+            return CORGI_OK;
+        }
+    }
+    CorgiUInt n;
+    if (dfa_closure(dfa, state->pcs, state->size, begin < at ? PROG_KIND(at[-1]) : PROG_KIND_NONE, state->kind, &n)) {
+        *match_begin = at;
+    }
+    return CORGI_OK;
+}
+
+static void
+dfa_add_set_match(Dfa* dfa, CorgiUInt pc, Bool* matched, CorgiUInt* matched_num)
+{
+    CorgiUInt id = dfa->prog.insts[pc].arg;
+    if (!matched[id]) {
+        matched[id] = TRUE;
+        (*matched_num)++;
+    }
+}
+
+static void
+dfa_add_set_matches(Dfa* dfa, DfaState* state, Bool* matched, CorgiUInt* matched_num)
+{
+    /* the matches which a state keeps are at the end of its threads */
+    CorgiUInt size = dfa->prog.size;
+    CorgiUInt i = state->size;
+    while ((0 < i) && (size <= state->pcs[i - 1])) {
+        i--;
+        dfa_add_set_match(dfa, state->pcs[i] - size, matched, matched_num);
+    }
+}
+
+static CorgiStatus
+dfa_search_set(Dfa* dfa, CorgiChar* begin, CorgiChar* end, CorgiChar* at, Bool* matched, CorgiUInt* matched_num, CorgiUInt patterns_num)
+{
+    /* runs the DFA of a set from at to the end of the string, or until all
+       patterns match. matched[i] tells whether the i-th pattern matches */
+    DfaState* state = dfa_start(dfa, begin < at ? PROG_KIND(at[-1]) : PROG_KIND_NONE, FALSE);
+    if (state == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiChar* found = NULL;
+    CorgiChar* ptr = at;
+    while (ptr < end) {
+        if (state->special) {
+            if (state->match) {
+                dfa_add_set_matches(dfa, state, matched, matched_num);
+                if (*matched_num == patterns_num) {
+                    return CORGI_OK;
+                }
+            }
+            if (state->start) {
+                CorgiChar* p = prog_skip(&dfa->prog, NULL, ptr, end, &found);
+                if (p == NULL) {
+                    return CORGI_OK;
+                }
+                if (p != ptr) {
+                    ptr = p;
+                    state = dfa_start(dfa, PROG_KIND(ptr[-1]), FALSE);
+                    if (state == NULL) {
+                        return ERR_OUT_OF_MEMORY;
+                    }
+                }
+            }
+        }
+        CorgiChar c = *ptr;
+        DfaState* next = c < 128 ? state->next[dfa->classes[c]] : NULL;
+        if (next == NULL) {
+            next = dfa_next(dfa, &state, c);
+            if (next == NULL) {
+                return ERR_OUT_OF_MEMORY;
+            }
+        }
+        state = next;
+        ptr++;
+    }
+    if (state->match) {
+        dfa_add_set_matches(dfa, state, matched, matched_num);
+    }
+    CorgiUInt n;
+    dfa_closure(dfa, state->pcs, state->size, state->kind, PROG_KIND_NONE, &n);
+    CorgiUInt i;
+    for (i = 0; i < n; i++) {
+        CorgiUInt pc = dfa->list[i];
+        if (dfa->prog.insts[pc].op == PROG_MATCH) {
+            dfa_add_set_match(dfa, pc, matched, matched_num);
+        }
+    }
+    return CORGI_OK;
+}
+
+/* the Pike VM runs all threads of a program at once, and keeps captures for
+   each thread */
+
+struct PikeList {
+    CorgiUInt size;
+    CorgiUInt* sparse;
+    CorgiUInt* dense;   /* the states of the threads in priority order */
+    CorgiInt* caps;     /* the captures of dense[i] are at caps[caps_num * i] */
+};
+
+typedef struct PikeList PikeList;
+
+/* an instruction to follow, or a capture to restore when slot is not -1 */
+struct PikeFrame {
+    CorgiUInt pc;
+    CorgiUInt empties;  /* see PROG_STATES_NUM */
+    CorgiInt slot;
+    CorgiInt value;
+};
+
+typedef struct PikeFrame PikeFrame;
+
+struct Pike {
+    Prog* prog;
+    CorgiChar* begin;
+    CorgiChar* end;
+    CorgiUInt groups_num;
+    CorgiUInt caps_num;
+    PikeList lists[2];
+    PikeFrame* stack;
+    CorgiInt* caps;
+    CorgiInt* matched;
+};
+
+typedef struct Pike Pike;
+
+static void
+fini_pike_list(PikeList* list)
+{
+    free(list->caps);
+    free(list->dense);
+    free(list->sparse);
+}
+
+static CorgiStatus
+init_pike_list(PikeList* list, CorgiUInt size, CorgiUInt caps_num)
+{
+    list->sparse = (CorgiUInt*)calloc(size, sizeof(CorgiUInt));
+    list->dense = (CorgiUInt*)malloc(sizeof(CorgiUInt) * size);
+    list->caps = (CorgiInt*)malloc(sizeof(CorgiInt) * caps_num * size);
+    if ((list->sparse == NULL) || (list->dense == NULL) || (list->caps == NULL)) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    return CORGI_OK;
+}
+
+static void
+fini_pike(Pike* pike)
+{
+    fini_pike_list(&pike->lists[1]);
+    fini_pike_list(&pike->lists[0]);
+    free(pike->matched);
+    free(pike->caps);
+    free(pike->stack);
+}
+
+static CorgiStatus
+init_pike(Pike* pike, Prog* prog, CorgiUInt groups_num, CorgiChar* begin, CorgiChar* end)
+{
+    bzero(pike, sizeof(*pike));
+    pike->prog = prog;
+    pike->begin = begin;
+    pike->end = end;
+    pike->groups_num = groups_num;
+    CorgiUInt caps_num = PROG_LOOP(groups_num, prog->loops_num);
+    pike->caps_num = caps_num;
+    CorgiUInt size = PROG_STATES_NUM(prog);
+    /* a state pushes at most three frames */
+    pike->stack = (PikeFrame*)malloc(sizeof(PikeFrame) * (3 * size + 1));
+    pike->caps = (CorgiInt*)malloc(sizeof(CorgiInt) * caps_num);
+    pike->matched = (CorgiInt*)malloc(sizeof(CorgiInt) * caps_num);
+    if ((pike->stack == NULL) || (pike->caps == NULL) || (pike->matched == NULL)) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiStatus status = init_pike_list(&pike->lists[0], size, caps_num);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    return init_pike_list(&pike->lists[1], size, caps_num);
+}
+
+static void
+pike_push(PikeFrame* stack, CorgiUInt* sp, CorgiUInt pc, CorgiUInt empties, CorgiInt slot, CorgiInt value)
+{
+    PikeFrame* frame = &stack[*sp];
+    frame->pc = pc;
+    frame->empties = empties;
+    frame->slot = slot;
+    frame->value = value;
+    (*sp)++;
+}
+
+static void
+pike_add(Pike* pike, PikeList* list, CorgiUInt pc, CorgiChar* ptr)
+{
+    /* adds a thread with pike->caps at ptr and the threads which it reaches
+       without taking a character in priority order. a SAVE changes
+       pike->caps until the threads after it are added */
+    Prog* prog = pike->prog;
+    CorgiInt* caps = pike->caps;
+    CorgiUInt caps_num = pike->caps_num;
+    CorgiUInt left = pike->begin < ptr ? PROG_KIND(ptr[-1]) : PROG_KIND_NONE;
+    CorgiUInt right = ptr < pike->end ? PROG_KIND(*ptr) : PROG_KIND_NONE;
+    PikeFrame* stack = pike->stack;
+    CorgiUInt sp = 0;
+    pike_push(stack, &sp, pc, 0, -1, 0);
+    while (0 < sp) {
+        sp--;
+        PikeFrame* frame = &stack[sp];
+        if (0 <= frame->slot) {
+            caps[frame->slot] = frame->value;
+            continue;
+        }
+        pc = frame->pc;
+        CorgiUInt empties = frame->empties;
+        CorgiUInt state = prog_state(prog, pc, empties);
+        if ((list->sparse[state] < list->size) && (list->dense[list->sparse[state]] == state)) {
+            continue;
+        }
+        CorgiUInt n = list->size;
+        list->sparse[state] = n;
+        list->dense[n] = state;
+        list->size++;
+        ProgInst* inst = &prog->insts[pc];
+        CorgiUInt lastindex;
+        CorgiUInt slot;
+        switch (inst->op) {
+        case PROG_AT:
+            if (prog_at(inst->arg, left, right)) {
+                pike_push(stack, &sp, inst->x, empties, -1, 0);
+            }
+            break;
+        case PROG_JUMP:
+            pike_push(stack, &sp, inst->x, empties, -1, 0);
+            break;
+        case PROG_SAVE:
+            pike_push(stack, &sp, 0, 0, inst->arg, caps[inst->arg]);
+            caps[inst->arg] = ptr - pike->begin;
+            if (inst->arg & 1) {
+                /* like MARK of the VM */
+                lastindex = PROG_LASTINDEX(pike->groups_num);
+                pike_push(stack, &sp, 0, 0, lastindex, caps[lastindex]);
+                caps[lastindex] = inst->arg / 2 + 1;
+            }
+            pike_push(stack, &sp, inst->x, empties, -1, 0);
+            break;
+        case PROG_REPEAT:
+            slot = PROG_LOOP(pike->groups_num, inst->arg);
+            pike_push(stack, &sp, 0, 0, slot, caps[slot]);
+            caps[slot] = ptr - pike->begin;
+            pike_push(stack, &sp, inst->x, empties + 1, -1, 0);
+            break;
+        case PROG_SPLIT:
+            pike_push(stack, &sp, inst->y, empties, -1, 0);
+            pike_push(stack, &sp, inst->x, empties, -1, 0);
+            break;
+        case PROG_UNTIL:
+            slot = PROG_LOOP(pike->groups_num, inst->arg);
+            if (caps[slot] != ptr - pike->begin) {
+                pike_push(stack, &sp, inst->x, empties, -1, 0);
+            }
+            else {
+                /* the iteration took no character */
+                pike_push(stack, &sp, inst->y, empties - 1, -1, 0);
+            }
+            break;
+        default:
+            memcpy(list->caps + caps_num * n, caps, sizeof(CorgiInt) * caps_num);
+            break;
+        }
+    }
+}
+
+static void
+pike_start(Pike* pike, PikeList* list, CorgiUInt pc, CorgiChar* ptr)
+{
+    /* adds the threads of a new match from ptr */
+    CorgiUInt i;
+    for (i = 0; i < pike->caps_num; i++) {
+        pike->caps[i] = -1;
+    }
+    pike->caps[PROG_BEGIN(pike->groups_num)] = ptr - pike->begin;
+    pike_add(pike, list, pc, ptr);
+}
+
+static CorgiStatus
+pike_search(Pike* pike, CorgiRegexp* regexp, CorgiChar* at, Bool anchored, CorgiChar** match_end)
+{
+    /* runs the threads from at in the lockstep. a match cuts the threads of
+       lower priority, so the leftmost match of the highest priority is the
+       last one. *match_end is NULL when there is no match */
+    Prog* prog = pike->prog;
+    CorgiChar* end = pike->end;
+    CorgiUInt caps_num = pike->caps_num;
+    PikeList* clist = &pike->lists[0];
+    PikeList* nlist = &pike->lists[1];
+    CorgiChar* found = NULL;
+    *match_end = NULL;
+    CorgiChar* ptr = at;
+    if (!anchored) {
+        ptr = prog_skip(prog, regexp, at, end, &found);
+        if (ptr == NULL) {
+            ptr = end;
+        }
+    }
+    clist->size = 0;
+    pike_start(pike, clist, anchored ? prog->start : prog->search, ptr);
+    while (0 < clist->size) {
+        nlist->size = 0;
+        Bool running = FALSE;
+        CorgiUInt i;
+        for (i = 0; i < clist->size; i++) {
+            ProgInst* inst = &prog->insts[PROG_STATE_PC(prog, clist->dense[i])];
+            CorgiInt* caps = clist->caps + caps_num * i;
+            if (inst->op == PROG_MATCH) {
+                memcpy(pike->matched, caps, sizeof(CorgiInt) * caps_num);
+                *match_end = ptr;
+                break;
+            }
+            if ((end <= ptr) || !prog_test(prog, inst, *ptr)) {
+                continue;
+            }
+            if (inst->op == PROG_ANY_ALL) {
+                /* tries the next position */
+                pike_start(pike, nlist, inst->x, ptr + 1);
+                continue;
+            }
+            memcpy(pike->caps, caps, sizeof(CorgiInt) * caps_num);
+            pike_add(pike, nlist, inst->x, ptr + 1);
+            running = TRUE;
+        }
+        if (end <= ptr) {
+            break;
+        }
+        ptr++;
+        if (!running && (*match_end == NULL) && !anchored && (ptr < end)) {
+            /* no thread is running. goes to where a match can start */
+            CorgiChar* p = prog_skip(prog, regexp, ptr, end, &found);
+            if (p == NULL) {
+                return CORGI_OK;
+            }
+            if (p != ptr) {
+                ptr = p;
+                nlist->size = 0;
+                pike_start(pike, nlist, prog->search, ptr);
+            }
+        }
+        PikeList* tmp = clist;
+        clist = nlist;
+        nlist = tmp;
+    }
+    return CORGI_OK;
+}
+
+/* the bit-state engine backtracks over a program in priority order like the
+   VM, and remembers the pairs of an instruction and a position which it has
+   tried in a bitmap. a pair which failed fails again, so each pair is tried
+   once. the bitmap is as large as the program times the string, so only
+   short strings are run */
+#define BITSTATE_BITS_MAX   (256 * 1024)
+#define BITSTATE_WORD_BITS  (8 * sizeof(CorgiUInt))
+
+struct BitStateJob {
+    CorgiUInt pc;
+    CorgiUInt empties;  /* see PROG_STATES_NUM */
+    CorgiChar* ptr;
+    CorgiInt slot;      /* a capture to restore instead of running, or -1 */
+    CorgiInt value;
+};
+
+typedef struct BitStateJob BitStateJob;
+
+struct BitState {
+    Prog* prog;
+    CorgiUInt groups_num;
+    CorgiChar* begin;
+    CorgiChar* end;
+    CorgiChar* at;      /* the first position of the bitmap */
+    CorgiUInt* visited;
+    BitStateJob* jobs;
+    CorgiUInt jobs_num;
+    CorgiUInt jobs_capacity;
+    CorgiInt* caps;
+};
+
+typedef struct BitState BitState;
+
+static Bool
+bitstate_fits(Prog* prog, CorgiChar* at, CorgiChar* end)
+{
+    return (CorgiUInt)(end - at) < BITSTATE_BITS_MAX / PROG_STATES_NUM(prog);
+}
+
+static void
+fini_bitstate(BitState* bitstate)
+{
+    free(bitstate->caps);
+    free(bitstate->jobs);
+    free(bitstate->visited);
+}
+
+static CorgiStatus
+init_bitstate(BitState* bitstate, Prog* prog, CorgiUInt groups_num, CorgiChar* begin, CorgiChar* end, CorgiChar* at)
+{
+    bzero(bitstate, sizeof(*bitstate));
+    bitstate->prog = prog;
+    bitstate->groups_num = groups_num;
+    bitstate->begin = begin;
+    bitstate->end = end;
+    bitstate->at = at;
+    CorgiUInt bits = PROG_STATES_NUM(prog) * (end - at + 1);
+    CorgiUInt words = (bits + BITSTATE_WORD_BITS - 1) / BITSTATE_WORD_BITS;
+    bitstate->visited = (CorgiUInt*)calloc(words, sizeof(CorgiUInt));
+    bitstate->caps = (CorgiInt*)malloc(sizeof(CorgiInt) * PROG_LOOP(groups_num, prog->loops_num));
+    if ((bitstate->visited == NULL) || (bitstate->caps == NULL)) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    return CORGI_OK;
+}
+
+static CorgiStatus
+bitstate_push(BitState* bitstate, CorgiUInt pc, CorgiUInt empties, CorgiChar* ptr, CorgiInt slot, CorgiInt value)
+{
+    if (bitstate->jobs_num == bitstate->jobs_capacity) {
+        CorgiUInt capacity = bitstate->jobs_capacity == 0 ? 64 : 2 * bitstate->jobs_capacity;
+        BitStateJob* jobs = (BitStateJob*)realloc(bitstate->jobs, sizeof(BitStateJob) * capacity);
+        if (jobs == NULL) {
+            return ERR_OUT_OF_MEMORY;
+        }
+        bitstate->jobs = jobs;
+        bitstate->jobs_capacity = capacity;
+    }
+    BitStateJob* job = &bitstate->jobs[bitstate->jobs_num];
+    job->pc = pc;
+    job->empties = empties;
+    job->ptr = ptr;
+    job->slot = slot;
+    job->value = value;
+    bitstate->jobs_num++;
+    return CORGI_OK;
+}
+
+static Bool
+bitstate_visit(BitState* bitstate, CorgiUInt pc, CorgiUInt empties, CorgiChar* ptr)
+{
+    /* returns FALSE when the pair of the state and ptr was tried */
+    CorgiUInt state = prog_state(bitstate->prog, pc, empties);
+    CorgiUInt n = state * (bitstate->end - bitstate->at + 1) + (ptr - bitstate->at);
+    CorgiUInt* word = &bitstate->visited[n / BITSTATE_WORD_BITS];
+    CorgiUInt bit = (CorgiUInt)1 << (n % BITSTATE_WORD_BITS);
+    if (*word & bit) {
+        return FALSE;
+    }
+    *word |= bit;
+    return TRUE;
+}
+
+static CorgiStatus
+bitstate_save(BitState* bitstate, CorgiCode slot, CorgiChar* ptr)
+{
+    /* the same as SAVE of the Pike VM. the old values come back when the
+       jobs after this fail */
+    CorgiInt* caps = bitstate->caps;
+    CorgiStatus status = bitstate_push(bitstate, 0, 0, NULL, slot, caps[slot]);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    caps[slot] = ptr - bitstate->begin;
+    if ((slot & 1) == 0) {
+        return CORGI_OK;
+    }
+    CorgiUInt lastindex = PROG_LASTINDEX(bitstate->groups_num);
+    status = bitstate_push(bitstate, 0, 0, NULL, lastindex, caps[lastindex]);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    caps[lastindex] = slot / 2 + 1;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+bitstate_try(BitState* bitstate, CorgiChar* start, CorgiInt* match_end)
+{
+    /* backtracks from start. the first MATCH is the match of the highest
+       priority, and bitstate->caps are its captures. *match_end is -1 when
+       there is no match */
+    Prog* prog = bitstate->prog;
+    CorgiChar* begin = bitstate->begin;
+    CorgiChar* end = bitstate->end;
+    CorgiInt* caps = bitstate->caps;
+    CorgiUInt i;
+    for (i = 0; i < PROG_LOOP(bitstate->groups_num, prog->loops_num); i++) {
+        caps[i] = -1;
+    }
+    caps[PROG_BEGIN(bitstate->groups_num)] = start - begin;
+    *match_end = -1;
+    bitstate->jobs_num = 0;
+    CorgiStatus status = bitstate_push(bitstate, prog->start, 0, start, -1, 0);
+    while ((status == CORGI_OK) && (0 < bitstate->jobs_num)) {
+        bitstate->jobs_num--;
+        BitStateJob* job = &bitstate->jobs[bitstate->jobs_num];
+        if (0 <= job->slot) {
+            caps[job->slot] = job->value;
+            continue;
+        }
+        CorgiUInt pc = job->pc;
+        CorgiUInt empties = job->empties;
+        CorgiChar* ptr = job->ptr;
+        while ((status == CORGI_OK) && bitstate_visit(bitstate, pc, empties, ptr)) {
+            ProgInst* inst = &prog->insts[pc];
+            CorgiUInt left;
+            CorgiUInt right;
+            CorgiUInt slot;
+            switch (inst->op) {
+            case PROG_AT:
+                left = begin < ptr ? PROG_KIND(ptr[-1]) : PROG_KIND_NONE;
+                right = ptr < end ? PROG_KIND(*ptr) : PROG_KIND_NONE;
+                if (!prog_at(inst->arg, left, right)) {
+                    break;
+                }
+                pc = inst->x;
+                continue;
+            case PROG_JUMP:
+                pc = inst->x;
+                continue;
+            case PROG_REPEAT:
+                slot = PROG_LOOP(bitstate->groups_num, inst->arg);
+                status = bitstate_push(bitstate, 0, 0, NULL, slot, caps[slot]);
+                caps[slot] = ptr - begin;
+                pc = inst->x;
+                empties++;
+                continue;
+            case PROG_SAVE:
+                status = bitstate_save(bitstate, inst->arg, ptr);
+                pc = inst->x;
+                continue;
+            case PROG_SPLIT:
+                status = bitstate_push(bitstate, inst->y, empties, ptr, -1, 0);
+                pc = inst->x;
+                continue;
+            case PROG_UNTIL:
+                slot = PROG_LOOP(bitstate->groups_num, inst->arg);
+                if (caps[slot] != ptr - begin) {
+                    pc = inst->x;
+                    continue;
+                }
+                /* the iteration took no character */
+                pc = inst->y;
+                empties--;
+                continue;
+            case PROG_MATCH:
+                *match_end = ptr - begin;
+                return CORGI_OK;
+            default:
+                if ((end <= ptr) || !prog_test(prog, inst, *ptr)) {
+                    break;
+                }
+                pc = inst->x;
+                empties = 0;
+                ptr++;
+                continue;
+            }
+            break;
+        }
+    }
+    return status;
+}
+
+static CorgiStatus
+bitstate_search(BitState* bitstate, CorgiRegexp* regexp, Bool anchored, CorgiInt* match_end)
+{
+    /* tries the positions from bitstate->at in order. a pair which failed
+       from a position fails from the later ones too, so they share the
+       bitmap */
+    Prog* prog = bitstate->prog;
+    CorgiChar* end = bitstate->end;
+    CorgiChar* found = NULL;
+    CorgiChar* ptr = bitstate->at;
+    for (;;) {
+        CorgiChar* p = anchored ? ptr : prog_skip(prog, regexp, ptr, end, &found);
+        if (p == NULL) {
+            /* an empty match may be at the end */
+            p = end;
+        }
+        CorgiStatus status = bitstate_try(bitstate, p, match_end);
+        if ((status != CORGI_OK) || (0 <= *match_end) || anchored || (end <= p)) {
+            return status;
+        }
+        ptr = p + 1;
+    }
+}
+
+/* a one-pass program has at most one thread which takes each character, so
+   it matches in one scan without backtracking or lists of threads. a state
+   is the instruction after a character. its entries are the instructions
+   which take the next character or MATCH, which the state reaches through
+   AT and SAVE (steps) in priority order */
+struct OnePassEntry {
+    CorgiUInt pc;
+    CorgiUInt next;     /* the state after the character */
+    CorgiUInt steps;    /* the first step in steps of CorgiOnePass */
+    CorgiUInt steps_num;
+    Bool at;            /* some of the steps are AT */
+};
+
+typedef struct OnePassEntry OnePassEntry;
+
+/* an entry of a state is one of at most ONEPASS_ENTRIES_MAX entries from its
+   first one */
+#define ONEPASS_ENTRIES_MAX 255
+#define ONEPASS_NO_ENTRY    255
+
+struct OnePassState {
+    CorgiUInt first;
+    CorgiUInt last;
+    CorgiUInt match;    /* the entry of MATCH, or ONEPASS_NO_ENTRY */
+    unsigned char table[128];   /* the entry which takes an ASCII character */
+    /* the entry which comes back to the state without steps, and the table
+       of its ASCII characters for corgi_skip_ascii(). the state never
+       matches with AT while it loops */
+    CorgiUInt loop;
+    unsigned char loop_table[16];
+};
+
+typedef struct OnePassState OnePassState;
+
+/* a program with more entries and steps is not one-pass */
+#define ONEPASS_SIZE_MAX    65536
+/* a state of a pc which is not a state */
+#define ONEPASS_NO_STATE    (~(CorgiUInt)0)
+/* a status only between onepass_check() and its callers */
+#define ONEPASS_AMBIGUOUS   (-2)
+
+struct CorgiOnePass {
+    Prog prog;
+    OnePassState* states;
+    CorgiUInt states_num;
+    OnePassEntry* entries;
+    CorgiUInt entries_num;
+    CorgiUInt entries_capacity;
+    CorgiUInt* steps;
+    CorgiUInt steps_num;
+    CorgiUInt steps_capacity;
+};
+
+typedef struct CorgiOnePass OnePass;
+
+static void
+free_onepass(OnePass* onepass)
+{
+    if (onepass == NULL) {
+        return;
+    }
+    free(onepass->steps);
+    free(onepass->entries);
+    free(onepass->states);
+    fini_prog(&onepass->prog);
+    free(onepass);
+}
+
+static Bool
+prog_is_ascii_set(CorgiCode* set)
+{
+    /* tells whether all members of a set are ASCII */
+    for (;;) {
+        switch (set[0]) {
+        case SRE_OP_FAILURE:
+            return TRUE;
+        case SRE_OP_ASCII_BITMAP:
+            set += 1 + SRE_ASCII_BITMAP_WORDS;
+            break;
+        case SRE_OP_CATEGORY:
+            switch (set[1]) {
+            case SRE_CATEGORY_DIGIT:
+            case SRE_CATEGORY_LINEBREAK:
+            case SRE_CATEGORY_SPACE:
+            case SRE_CATEGORY_WORD:
+                break;
+            default:
+                return FALSE;
+            }
+            set += 2;
+            break;
+        case SRE_OP_CHARSET:
+            if ((set[5] != 0) || (set[6] != 0) || (set[7] != 0) || (set[8] != 0)) {
+                return FALSE;
+            }
+            set += 9;
+            break;
+        case SRE_OP_LITERAL:
+            if (128 <= set[1]) {
+                return FALSE;
+            }
+            set += 2;
+            break;
+        case SRE_OP_RANGE:
+            if (128 <= set[2]) {
+                return FALSE;
+            }
+            set += 3;
+            break;
+        default:
+            return FALSE;
+        }
+    }
+}
+
+static Bool
+prog_takes_non_ascii(Prog* prog, ProgInst* inst)
+{
+    /* tells whether an instruction can take a non-ASCII character. only
+       letters have non-ASCII characters of the same case */
+    CorgiCode c = inst->arg;
+    switch (inst->op) {
+    case PROG_CATEGORY:
+        switch (c) {
+        case SRE_CATEGORY_DIGIT:
+        case SRE_CATEGORY_LINEBREAK:
+        case SRE_CATEGORY_SPACE:
+        case SRE_CATEGORY_WORD:
+            return FALSE;
+        default:
+            return TRUE;
+        }
+    case PROG_IN:
+        return prog->ignore_case || !prog_is_ascii_set(inst->set + 2);
+    case PROG_LITERAL:
+        return (128 <= c) || (prog->ignore_case && ('a' <= c) && (c <= 'z'));
     default:
-        assert(FALSE);
+        return TRUE;
     }
+}
 
-    return 0; /* gcc dislike this function without this statement */
+static CorgiStatus
+onepass_add_entry(OnePass* onepass, CorgiUInt pc, CorgiUInt* path, CorgiUInt path_size)
+{
+    if (ONEPASS_SIZE_MAX < onepass->entries_num + onepass->steps_num + path_size) {
+        return ONEPASS_AMBIGUOUS;
+    }
+    if (onepass->entries_num == onepass->entries_capacity) {
+        CorgiUInt capacity = onepass->entries_capacity == 0 ? 64 : 2 * onepass->entries_capacity;
+        OnePassEntry* entries = (OnePassEntry*)realloc(onepass->entries, sizeof(OnePassEntry) * capacity);
+        if (entries == NULL) {
+            return ERR_OUT_OF_MEMORY;
+        }
+        onepass->entries = entries;
+        onepass->entries_capacity = capacity;
+    }
+    CorgiUInt steps_num = onepass->steps_num;
+    if (onepass->steps_capacity < steps_num + path_size) {
+        CorgiUInt capacity = onepass->steps_capacity == 0 ? 64 : onepass->steps_capacity;
+        while (capacity < steps_num + path_size) {
+            capacity *= 2;
+        }
+        CorgiUInt* steps = (CorgiUInt*)realloc(onepass->steps, sizeof(CorgiUInt) * capacity);
+        if (steps == NULL) {
+            return ERR_OUT_OF_MEMORY;
+        }
+        onepass->steps = steps;
+        onepass->steps_capacity = capacity;
+    }
+    if (0 < path_size) {
+        memcpy(onepass->steps + steps_num, path, sizeof(CorgiUInt) * path_size);
+    }
+    onepass->steps_num += path_size;
+    OnePassEntry* entry = &onepass->entries[onepass->entries_num];
+    entry->pc = pc;
+    entry->next = ONEPASS_NO_STATE;
+    entry->steps = steps_num;
+    entry->steps_num = path_size;
+    entry->at = FALSE;
+    CorgiUInt i;
+    for (i = 0; i < path_size; i++) {
+        if (onepass->prog.insts[path[i]].op == PROG_AT) {
+            entry->at = TRUE;
+        }
+    }
+    onepass->entries_num++;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+onepass_add_entries(OnePass* onepass, CorgiUInt pc, CorgiUInt* stack, CorgiUInt* path, CorgiUInt* sparse, CorgiUInt* dense)
+{
+    /* adds the entries which pc reaches. reaching an instruction twice is
+       ambiguous. the stack has pcs to visit, and pcs + size to pop from the
+       path */
+    Prog* prog = &onepass->prog;
+    CorgiUInt size = prog->size;
+    CorgiUInt visited = 0;
+    CorgiUInt path_size = 0;
+    CorgiUInt sp = 0;
+    stack[sp] = pc;
+    sp++;
+    while (0 < sp) {
+        sp--;
+        pc = stack[sp];
+        if (size <= pc) {
+            path_size--;
+            continue;
+        }
+        if ((sparse[pc] < visited) && (dense[sparse[pc]] == pc)) {
+            return ONEPASS_AMBIGUOUS;
+        }
+        sparse[pc] = visited;
+        dense[visited] = pc;
+        visited++;
+        ProgInst* inst = &prog->insts[pc];
+        CorgiStatus status;
+        switch (inst->op) {
+        case PROG_AT:
+        case PROG_SAVE:
+            path[path_size] = pc;
+            path_size++;
+            stack[sp] = pc + size;
+            stack[sp + 1] = inst->x;
+            sp += 2;
+            break;
+        case PROG_JUMP:
+            stack[sp] = inst->x;
+            sp++;
+            break;
+        case PROG_REPEAT:
+        case PROG_UNTIL:
+            /* the body of the loop can match an empty string, so there are
+               two ways out of the loop */
+            return ONEPASS_AMBIGUOUS;
+        case PROG_SPLIT:
+            stack[sp] = inst->y;
+            stack[sp + 1] = inst->x;
+            sp += 2;
+            break;
+        default:
+            status = onepass_add_entry(onepass, pc, path, path_size);
+            if (status != CORGI_OK) {
+                return status;
+            }
+            break;
+        }
+    }
+    return CORGI_OK;
+}
+
+static CorgiStatus
+onepass_add_state(OnePass* onepass, CorgiUInt pc, CorgiUInt* stack, CorgiUInt* path, CorgiUInt* sparse, CorgiUInt* dense)
+{
+    /* makes the state at pc. two entries taking the same character are
+       ambiguous */
+    Prog* prog = &onepass->prog;
+    CorgiUInt first = onepass->entries_num;
+    CorgiStatus status = onepass_add_entries(onepass, pc, stack, path, sparse, dense);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    CorgiUInt last = onepass->entries_num;
+    if (ONEPASS_ENTRIES_MAX <= last - first) {
+        return ONEPASS_AMBIGUOUS;
+    }
+    OnePassState* state = &onepass->states[onepass->states_num];
+    state->first = first;
+    state->last = last;
+    state->match = ONEPASS_NO_ENTRY;
+    memset(state->table, ONEPASS_NO_ENTRY, sizeof(state->table));
+    Bool non_ascii = FALSE;
+    CorgiUInt i;
+    for (i = first; i < last; i++) {
+        ProgInst* inst = &prog->insts[onepass->entries[i].pc];
+        if (inst->op == PROG_MATCH) {
+            state->match = i - first;
+            continue;
+        }
+        if (prog_takes_non_ascii(prog, inst)) {
+            if (non_ascii) {
+                return ONEPASS_AMBIGUOUS;
+            }
+            non_ascii = TRUE;
+        }
+        CorgiChar c;
+        for (c = 0; c < 128; c++) {
+            if (!prog_test(prog, inst, c)) {
+                continue;
+            }
+            if (state->table[c] != ONEPASS_NO_ENTRY) {
+                return ONEPASS_AMBIGUOUS;
+            }
+            state->table[c] = i - first;
+        }
+    }
+    onepass->states_num++;
+    return CORGI_OK;
+}
+
+static void
+onepass_compute_loop(OnePass* onepass, CorgiUInt n)
+{
+    OnePassState* state = &onepass->states[n];
+    state->loop = ONEPASS_NO_ENTRY;
+    CorgiUInt match = state->match;
+    if ((match != ONEPASS_NO_ENTRY) && onepass->entries[state->first + match].at) {
+        return;
+    }
+    CorgiUInt i;
+    for (i = state->first; i < state->last; i++) {
+        OnePassEntry* entry = &onepass->entries[i];
+        if ((entry->next == n) && (entry->steps_num == 0) && ((match == ONEPASS_NO_ENTRY) || (state->first + match > i))) {
+            state->loop = i - state->first;
+            break;
+        }
+    }
+    bzero(state->loop_table, sizeof(state->loop_table));
+    CorgiChar c;
+    for (c = 0; c < 128; c++) {
+        if ((state->loop != ONEPASS_NO_ENTRY) && (state->table[c] == state->loop)) {
+            state->loop_table[c & 15] |= 1 << (c >> 4);
+        }
+    }
+}
+
+static CorgiStatus
+onepass_compute_states(OnePass* onepass, CorgiUInt* states, CorgiUInt* stack, CorgiUInt* path, CorgiUInt* sparse, CorgiUInt* dense)
+{
+    /* makes the states from the start. states has the state of each pc */
+    Prog* prog = &onepass->prog;
+    CorgiUInt i;
+    for (i = 0; i < prog->size; i++) {
+        states[i] = ONEPASS_NO_STATE;
+    }
+    states[prog->start] = 0;
+    CorgiStatus status = onepass_add_state(onepass, prog->start, stack, path, sparse, dense);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    /* the entries grow while they are read */
+    for (i = 0; i < onepass->entries_num; i++) {
+        OnePassEntry* entry = &onepass->entries[i];
+        ProgInst* inst = &prog->insts[entry->pc];
+        if (inst->op == PROG_MATCH) {
+            continue;
+        }
+        if (states[inst->x] == ONEPASS_NO_STATE) {
+            states[inst->x] = onepass->states_num;
+            status = onepass_add_state(onepass, inst->x, stack, path, sparse, dense);
+            if (status != CORGI_OK) {
+                return status;
+            }
+        }
+        onepass->entries[i].next = states[inst->x];
+    }
+    for (i = 0; i < onepass->states_num; i++) {
+        onepass_compute_loop(onepass, i);
+    }
+    return CORGI_OK;
+}
+
+static CorgiStatus
+onepass_check(OnePass* onepass)
+{
+    /* makes the states of a one-pass program, or returns ONEPASS_AMBIGUOUS */
+    Prog* prog = &onepass->prog;
+    CorgiUInt size = prog->size;
+    onepass->states = (OnePassState*)malloc(sizeof(OnePassState) * size);
+    CorgiUInt* states = (CorgiUInt*)malloc(sizeof(CorgiUInt) * size);
+    CorgiUInt* stack = (CorgiUInt*)malloc(sizeof(CorgiUInt) * (2 * size + 1));
+    CorgiUInt* path = (CorgiUInt*)malloc(sizeof(CorgiUInt) * size);
+    CorgiUInt* sparse = (CorgiUInt*)calloc(size, sizeof(CorgiUInt));
+    CorgiUInt* dense = (CorgiUInt*)malloc(sizeof(CorgiUInt) * size);
+    CorgiStatus status = ERR_OUT_OF_MEMORY;
+    if ((onepass->states != NULL) && (states != NULL) && (stack != NULL) && (path != NULL) && (sparse != NULL) && (dense != NULL)) {
+        status = onepass_compute_states(onepass, states, stack, path, sparse, dense);
+    }
+    free(dense);
+    free(sparse);
+    free(path);
+    free(stack);
+    free(states);
+    return status;
+}
+
+static Bool
+onepass_holds(OnePass* onepass, OnePassEntry* entry, CorgiChar* begin, CorgiChar* end, CorgiChar* ptr)
+{
+    /* tells whether the ATs before an entry hold at ptr */
+    if (!entry->at) {
+        return TRUE;
+    }
+    CorgiUInt left = begin < ptr ? PROG_KIND(ptr[-1]) : PROG_KIND_NONE;
+    CorgiUInt right = ptr < end ? PROG_KIND(*ptr) : PROG_KIND_NONE;
+    CorgiUInt* steps = onepass->steps + entry->steps;
+    CorgiUInt i;
+    for (i = 0; i < entry->steps_num; i++) {
+        ProgInst* inst = &onepass->prog.insts[steps[i]];
+        if ((inst->op == PROG_AT) && !prog_at(inst->arg, left, right)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void
+onepass_save(OnePass* onepass, OnePassEntry* entry, CorgiUInt groups_num, CorgiInt* caps, CorgiInt pos)
+{
+    /* does the SAVEs before an entry */
+    CorgiUInt* steps = onepass->steps + entry->steps;
+    CorgiUInt i;
+    for (i = 0; i < entry->steps_num; i++) {
+        ProgInst* inst = &onepass->prog.insts[steps[i]];
+        if (inst->op != PROG_SAVE) {
+            continue;
+        }
+        caps[inst->arg] = pos;
+        if (inst->arg & 1) {
+            /* like MARK of the VM */
+            caps[PROG_LASTINDEX(groups_num)] = inst->arg / 2 + 1;
+        }
+    }
+}
+
+static CorgiUInt
+onepass_find(OnePass* onepass, OnePassState* state, CorgiChar c)
+{
+    /* returns the entry which takes a non-ASCII character */
+    CorgiUInt i;
+    for (i = state->first; i < state->last; i++) {
+        ProgInst* inst = &onepass->prog.insts[onepass->entries[i].pc];
+        if ((inst->op != PROG_MATCH) && prog_test(&onepass->prog, inst, c)) {
+            return i - state->first;
+        }
+    }
+    return ONEPASS_NO_ENTRY;
+}
+
+static void
+onepass_match(OnePass* onepass, CorgiUInt groups_num, CorgiChar* begin, CorgiChar* end, CorgiChar* at, CorgiInt* caps, CorgiInt* matched, CorgiInt* match_end)
+{
+    /* runs the only thread from at. a MATCH of lower priority than the thread
+       is remembered in matched, and is the match when the thread fails.
+       *match_end is -1 when there is no match */
+    CorgiUInt caps_num = PROG_CAPS_NUM(groups_num);
+    CorgiUInt i;
+    for (i = 0; i < caps_num; i++) {
+        caps[i] = -1;
+    }
+    caps[PROG_BEGIN(groups_num)] = at - begin;
+    *match_end = -1;
+    OnePassState* state = &onepass->states[0];
+    CorgiChar* ptr;
+    for (ptr = at; ; ptr++) {
+        CorgiUInt next = ONEPASS_NO_ENTRY;
+        if (ptr < end) {
+            CorgiChar c = *ptr;
+            next = c < 128 ? state->table[c] : onepass_find(onepass, state, c);
+        }
+        OnePassEntry* entry = NULL;
+        if (next != ONEPASS_NO_ENTRY) {
+            entry = &onepass->entries[state->first + next];
+            if (!onepass_holds(onepass, entry, begin, end, ptr)) {
+                entry = NULL;
+            }
+        }
+        CorgiUInt match = state->match;
+        if (match != ONEPASS_NO_ENTRY) {
+            OnePassEntry* e = &onepass->entries[state->first + match];
+            if (onepass_holds(onepass, e, begin, end, ptr)) {
+                memcpy(matched, caps, sizeof(CorgiInt) * caps_num);
+                onepass_save(onepass, e, groups_num, matched, ptr - begin);
+                *match_end = ptr - begin;
+                if ((entry == NULL) || (match < next)) {
+                    return;
+                }
+            }
+        }
+        if (entry == NULL) {
+            return;
+        }
+        onepass_save(onepass, entry, groups_num, caps, ptr - begin);
+        if (next == state->loop) {
+            /* the entry takes the following characters without changing
+               anything */
+            ptr = corgi_skip_ascii(ptr + 1, end, state->loop_table) - 1;
+        }
+        state = &onepass->states[entry->next];
+    }
+}
+
+/* the Shift-And engine runs the Glushkov automaton of a short pattern with
+   bits of a word. a position is an instruction of a program which takes a
+   character, and a bit of a state tells that a thread is at the position
+   after its character */
+#define SHIFT_AND_POSITIONS_MAX (8 * sizeof(CorgiUInt))
+#define SHIFT_AND_CHUNKS_NUM    sizeof(CorgiUInt)
+
+struct CorgiShiftAnd {
+    Prog prog;
+    CorgiUInt pcs[SHIFT_AND_POSITIONS_MAX];
+    CorgiUInt positions_num;
+    CorgiUInt masks[128];   /* the positions which take an ASCII character */
+    CorgiUInt first;        /* the positions which start a match */
+    CorgiUInt last;         /* the positions which end a match */
+    Bool shift;             /* each position follows only the previous one */
+    /* the positions which follow the positions of each byte of a state */
+    CorgiUInt follows[SHIFT_AND_CHUNKS_NUM][256];
+};
+
+typedef struct CorgiShiftAnd ShiftAnd;
+
+static void
+free_shift_and(ShiftAnd* shift_and)
+{
+    if (shift_and == NULL) {
+        return;
+    }
+    fini_prog(&shift_and->prog);
+    free(shift_and);
+}
+
+static CorgiUInt
+shift_and_reach(ShiftAnd* shift_and, CorgiUInt pc, CorgiUInt* positions, CorgiUInt* stack, Bool* visited, Bool* match)
+{
+    /* returns the positions which pc reaches without taking a character.
+       *match tells whether it reaches MATCH */
+    Prog* prog = &shift_and->prog;
+    bzero(visited, sizeof(Bool) * prog->size);
+    *match = FALSE;
+    CorgiUInt reached = 0;
+    CorgiUInt sp = 0;
+    stack[sp] = pc;
+    sp++;
+    while (0 < sp) {
+        sp--;
+        pc = stack[sp];
+        if (visited[pc]) {
+            continue;
+        }
+        visited[pc] = TRUE;
+        ProgInst* inst = &prog->insts[pc];
+        switch (inst->op) {
+        case PROG_JUMP:
+        case PROG_REPEAT:
+        case PROG_SAVE:
+            stack[sp] = inst->x;
+            sp++;
+            break;
+        case PROG_SPLIT:
+        case PROG_UNTIL:
+            stack[sp] = inst->y;
+            stack[sp + 1] = inst->x;
+            sp += 2;
+            break;
+        case PROG_MATCH:
+            *match = TRUE;
+            break;
+        default:
+            reached |= (CorgiUInt)1 << positions[pc];
+            break;
+        }
+    }
+    return reached;
+}
+
+static CorgiStatus
+shift_and_compute(ShiftAnd* shift_and, CorgiUInt* positions, CorgiUInt* stack, Bool* visited)
+{
+    Prog* prog = &shift_and->prog;
+    Bool match;
+    shift_and->first = shift_and_reach(shift_and, prog->start, positions, stack, visited, &match);
+    if (match) {
+        /* an empty match is not searched */
+        return PROG_TOO_LARGE;
+    }
+    CorgiUInt follows[SHIFT_AND_POSITIONS_MAX];
+    shift_and->last = 0;
+    shift_and->shift = TRUE;
+    CorgiUInt n = shift_and->positions_num;
+    CorgiUInt i;
+    for (i = 0; i < n; i++) {
+        ProgInst* inst = &prog->insts[shift_and->pcs[i]];
+        follows[i] = shift_and_reach(shift_and, inst->x, positions, stack, visited, &match);
+        if (match) {
+            shift_and->last |= (CorgiUInt)1 << i;
+        }
+        CorgiUInt next = i + 1 < n ? (CorgiUInt)1 << (i + 1) : 0;
+        if (follows[i] != next) {
+            shift_and->shift = FALSE;
+        }
+        CorgiChar c;
+        for (c = 0; c < 128; c++) {
+            if (prog_test(prog, inst, c)) {
+                shift_and->masks[c] |= (CorgiUInt)1 << i;
+            }
+        }
+    }
+    CorgiUInt j;
+    for (j = 0; j < SHIFT_AND_CHUNKS_NUM; j++) {
+        CorgiUInt b;
+        for (b = 0; b < 256; b++) {
+            CorgiUInt follow = 0;
+            for (i = 0; i < 8; i++) {
+                CorgiUInt k = 8 * j + i;
+                if ((k < n) && (b & (1 << i))) {
+                    follow |= follows[k];
+                }
+            }
+            shift_and->follows[j][b] = follow;
+        }
+    }
+    return CORGI_OK;
+}
+
+static CorgiStatus
+shift_and_compute_positions(ShiftAnd* shift_and)
+{
+    /* numbers the instructions taking a character. a pattern with AT or too
+       many positions gets no automaton */
+    Prog* prog = &shift_and->prog;
+    CorgiUInt* positions = (CorgiUInt*)malloc(sizeof(CorgiUInt) * prog->size);
+    CorgiUInt* stack = (CorgiUInt*)malloc(sizeof(CorgiUInt) * (2 * prog->size + 1));
+    Bool* visited = (Bool*)malloc(sizeof(Bool) * prog->size);
+    CorgiStatus status = ERR_OUT_OF_MEMORY;
+    if ((positions != NULL) && (stack != NULL) && (visited != NULL)) {
+        status = CORGI_OK;
+    }
+    CorgiUInt n = 0;
+    CorgiUInt pc;
+    /* the instructions after MATCH are of searches */
+    for (pc = 0; (status == CORGI_OK) && (pc < prog->search); pc++) {
+        switch (prog->insts[pc].op) {
+        case PROG_AT:
+            status = PROG_TOO_LARGE;
+            break;
+        case PROG_ANY:
+        case PROG_CATEGORY:
+        case PROG_IN:
+        case PROG_LITERAL:
+        case PROG_NOT_LITERAL:
+            if (n == SHIFT_AND_POSITIONS_MAX) {
+                status = PROG_TOO_LARGE;
+                break;
+            }
+            shift_and->pcs[n] = pc;
+            positions[pc] = n;
+            n++;
+            break;
+        default:
+            break;
+        }
+    }
+    shift_and->positions_num = n;
+    if (status == CORGI_OK) {
+        status = shift_and_compute(shift_and, positions, stack, visited);
+    }
+    free(visited);
+    free(stack);
+    free(positions);
+    return status;
+}
+
+static CorgiUInt
+shift_and_mask(ShiftAnd* shift_and, CorgiChar c)
+{
+    if (c < 128) {
+        return shift_and->masks[c];
+    }
+    CorgiUInt mask = 0;
+    CorgiUInt i;
+    for (i = 0; i < shift_and->positions_num; i++) {
+        if (prog_test(&shift_and->prog, &shift_and->prog.insts[shift_and->pcs[i]], c)) {
+            mask |= (CorgiUInt)1 << i;
+        }
+    }
+    return mask;
+}
+
+static CorgiUInt
+shift_and_follow(ShiftAnd* shift_and, CorgiUInt state)
+{
+    if (shift_and->shift) {
+        return state << 1;
+    }
+    CorgiUInt follow = 0;
+    CorgiUInt i;
+    for (i = 0; state != 0; i++) {
+        follow |= shift_and->follows[i][state & 255];
+        state >>= 8;
+    }
+    return follow;
+}
+
+static CorgiInt
+sre_search_shift_and(State* state, CorgiCode* pattern)
+{
+    /* the automaton finds where a match ends. a match ending there starts
+       after the last position where no thread was running, and after the
+       positions tried before, so sre_match() is tried only in that window */
+    CorgiRegexp* regexp = state->regexp;
+    ShiftAnd* shift_and = regexp->shift_and;
+    CorgiUInt max = regexp->max_width;
+    CorgiChar* ptr = state->start;
+    CorgiChar* end = state->end;
+    CorgiChar* tried = ptr;
+    CorgiChar* alive = ptr;
+    CorgiChar* found = NULL;
+    CorgiUInt threads = 0;
+    while (ptr < end) {
+        if (threads == 0) {
+            ptr = prog_skip(&shift_and->prog, regexp, ptr, end, &found);
+            if (ptr == NULL) {
+                return 0;
+            }
+            alive = ptr;
+        }
+        threads = (shift_and_follow(shift_and, threads) | shift_and->first) & shift_and_mask(shift_and, *ptr);
+        ptr++;
+        if ((threads & shift_and->last) == 0) {
+            continue;
+        }
+        CorgiChar* p = tried < alive ? alive : tried;
+        if ((max != CORGI_WIDTH_UNBOUNDED) && (max < (CorgiUInt)(ptr - p))) {
+            p = ptr - max;
+        }
+        for (; p < ptr; p++) {
+            if (!sre_can_start_with(pattern, *p)) {
+                continue;
+            }
+            TRACE(("|%p|%p|SEARCH SHIFT AND\n", pattern, p));
+            state->start = state->ptr = p;
+            CorgiInt status = sre_match(state, pattern);
+            if (status != 0) {
+                return status;
+            }
+        }
+        tried = ptr;
+    }
+    return 0;
 }
 
-static CorgiUInt
-get_instruction_size(Instruction* inst)
+static CorgiStatus
+check_onepass(Compiler* compiler, Node* node)
 {
-    if (inst->type == INST_LABEL) {
-        return 0;
+    /* returns CORGI_OK when a pattern is one-pass, or ONEPASS_AMBIGUOUS */
+    OnePass* onepass = (OnePass*)calloc(1, sizeof(OnePass));
+    if (onepass == NULL) {
+        return ERR_OUT_OF_MEMORY;
     }
-    return 1 + get_operands_number(inst);
+    CorgiStatus status = compile_prog(compiler, node, FALSE, &onepass->prog);
+    if (status == CORGI_OK) {
+        status = onepass_check(onepass);
+    }
+    free_onepass(onepass);
+    return status;
 }
 
-static CorgiUInt
-compute_instruction_position(Instruction* inst)
+static CorgiStatus
+compile_onepass(Compiler* compiler, CorgiRegexp* regexp)
 {
-    CorgiUInt pos = 0;
-    Instruction* i;
-    for (i = inst; i != NULL; i = i->next) {
-        i->pos = pos;
-        pos += get_instruction_size(i);
+    /* makes the one-pass program of a pattern with groups, which
+       corgi_match() runs instead of the VM. a pattern which is not one-pass
+       gets no program */
+    Node* node = compiler->root;
+    if (!compiler->optimize || (regexp->groups_num == 0) || !is_prog_node(node)) {
+        return CORGI_OK;
     }
-    return pos;
+    OnePass* onepass = (OnePass*)calloc(1, sizeof(OnePass));
+    if (onepass == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiStatus status = compile_prog(compiler, node, FALSE, &onepass->prog);
+    if (status == CORGI_OK) {
+        status = onepass_check(onepass);
+    }
+    if (status != CORGI_OK) {
+        free_onepass(onepass);
+        return (status == PROG_TOO_LARGE) || (status == ONEPASS_AMBIGUOUS) ? CORGI_OK : status;
+    }
+    regexp->onepass = onepass;
+    return CORGI_OK;
 }
 
-static void
-write_code(Compiler* compiler, CorgiCode** code, Instruction* inst)
+static CorgiStatus
+compile_shift_and(Compiler* compiler, CorgiRegexp* regexp)
 {
-    switch (inst->type) {
-    case INST_ANY:
-        **code = SRE_OP_ANY;
-        (*code)++;
-        break;
-    case INST_AT:
-        **code = SRE_OP_AT;
-        (*code)++;
-        **code = inst->u.at.type;
-        (*code)++;
-        break;
-    case INST_BRANCH:
-        **code = SRE_OP_BRANCH;
-        (*code)++;
-        break;
-    case INST_CATEGORY:
-        **code = SRE_OP_CATEGORY;
-        (*code)++;
-        **code = inst->u.category.type;
-        (*code)++;
-        break;
-    case INST_FAILURE:
-        **code = SRE_OP_FAILURE;
-        (*code)++;
-        break;
-    case INST_IN:
-        **code = SRE_OP_IN;
-        (*code)++;
-        **code = inst->u.in.dest->pos - inst->pos - 1;
-        (*code)++;
-        break;
-    case INST_JUMP:
-        **code = SRE_OP_JUMP;
-        (*code)++;
-        **code = inst->u.jump.dest->pos - inst->pos - 1;
-        (*code)++;
-        break;
-    case INST_LABEL:
-        break;
-    case INST_LITERAL:
-        **code = compiler->ignore_case ? SRE_OP_LITERAL_IGNORE : SRE_OP_LITERAL;
-        (*code)++;
-        **code = inst->u.literal.c;
-        (*code)++;
-        break;
-    case INST_MARK:
-        **code = SRE_OP_MARK;
-        (*code)++;
-        **code = inst->u.mark.id;
-        (*code)++;
-        break;
-    case INST_MAX_UNTIL:
-        **code = SRE_OP_MAX_UNTIL;
-        (*code)++;
-        break;
-    case INST_MIN_UNTIL:
-        **code = SRE_OP_MIN_UNTIL;
-        (*code)++;
-        break;
-    case INST_NEGATE:
-        **code = SRE_OP_NEGATE;
-        (*code)++;
-        break;
-    case INST_OFFSET:
-        **code = inst->u.offset.dest->pos - inst->pos;
-        (*code)++;
-        break;
-    case INST_RANGE:
-        **code = SRE_OP_RANGE;
-        (*code)++;
-        **code = inst->u.range.low;
-        (*code)++;
-        **code = inst->u.range.high;
-        (*code)++;
-        break;
-    case INST_REPEAT:
-        **code = SRE_OP_REPEAT;
-        (*code)++;
-        **code = inst->u.repeat.dest->pos - inst->pos - 1;
-        (*code)++;
-        **code = inst->u.repeat.min;
-        (*code)++;
-        **code = inst->u.repeat.max;
-        (*code)++;
-        break;
-    case INST_SUCCESS:
-        **code = SRE_OP_SUCCESS;
-        (*code)++;
-        break;
-    default:
-        assert(FALSE);
+    /* makes the Shift-And automaton of a short pattern, which corgi_search()
+       runs before the VM. the VM is faster for a pattern with a literal
+       prefix, which it finds by itself */
+    Node* node = compiler->root;
+    if (!compiler->optimize || (regexp->dfa != NULL) || !is_prog_node(node)) {
+        return CORGI_OK;
+    }
+    CorgiCode* code = regexp->code;
+    if ((code[0] == SRE_OP_INFO) && (code[2] & SRE_INFO_PREFIX)) {
+        return CORGI_OK;
+    }
+    ShiftAnd* shift_and = (ShiftAnd*)calloc(1, sizeof(ShiftAnd));
+    if (shift_and == NULL) {
+        return ERR_OUT_OF_MEMORY;
     }
+    CorgiStatus status = compile_prog(compiler, node, FALSE, &shift_and->prog);
+    if (status == CORGI_OK) {
+        status = shift_and_compute_positions(shift_and);
+    }
+    if (status != CORGI_OK) {
+        free_shift_and(shift_and);
+        return status == PROG_TOO_LARGE ? CORGI_OK : status;
+    }
+    regexp->shift_and = shift_and;
+    return CORGI_OK;
 }
 
-static void
-instruction2binary(Compiler* compiler, CorgiCode* code, Instruction* inst)
+static CorgiStatus
+compile_linear(Compiler* compiler, CorgiRegexp* regexp)
 {
-    CorgiCode** p = &code;
-    Instruction* i;
-    for (i = inst; i != NULL; i = i->next) {
-        write_code(compiler, p, i);
+    /* makes the program of the Pike VM. a pattern which a program cannot run
+       gets no program, and the backtracking VM runs it. the DFAs run a
+       pattern without groups when they exist */
+    Node* node = compiler->root;
+    if (!compiler->linear || ((regexp->dfa != NULL) && (regexp->groups_num == 0)) || !is_prog_node(node)) {
+        return CORGI_OK;
+    }
+    Prog* prog = (Prog*)malloc(sizeof(Prog));
+    if (prog == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiStatus status = compile_prog(compiler, node, FALSE, prog);
+    if (status != CORGI_OK) {
+        free_prog(prog);
+        return status == PROG_TOO_LARGE ? CORGI_OK : status;
     }
+    regexp->prog = prog;
+    return CORGI_OK;
 }
 
 static CorgiStatus
-instruction2code(Compiler* compiler, Instruction* inst, CorgiCode** code, CorgiUInt* code_size)
+compile_bitstate(Compiler* compiler, CorgiRegexp* regexp)
 {
-    *code_size = compute_instruction_position(inst);
-    *code = (CorgiCode*)malloc(sizeof(CorgiCode) * *code_size);
-    if (*code == NULL) {
+    /* makes the program of the bit-state engine, which runs short strings
+       instead of the VM. it is not needed when the DFAs or the Pike VM run a
+       pattern by themselves. the VM backtracks at most one step at each
+       choice of a one-pass pattern, so only an ambiguous pattern gets the
+       program */
+    Node* node = compiler->root;
+    if (!compiler->optimize || (regexp->prog != NULL) || ((regexp->dfa != NULL) && (regexp->groups_num == 0)) || (regexp->onepass != NULL) || !is_prog_node(node)) {
+        return CORGI_OK;
+    }
+    CorgiStatus status;
+    if (regexp->groups_num == 0) {
+        /* compile_onepass() did not check a pattern without groups */
+        status = check_onepass(compiler, node);
+        if (status != ONEPASS_AMBIGUOUS) {
+            return (status == CORGI_OK) || (status == PROG_TOO_LARGE) ? CORGI_OK : status;
+        }
+    }
+    Prog* prog = (Prog*)malloc(sizeof(Prog));
+    if (prog == NULL) {
         return ERR_OUT_OF_MEMORY;
     }
-    instruction2binary(compiler, *code, inst);
+    status = compile_prog(compiler, node, FALSE, prog);
+    if (status != CORGI_OK) {
+        free_prog(prog);
+        return status == PROG_TOO_LARGE ? CORGI_OK : status;
+    }
+    regexp->bitstate = prog;
+    return CORGI_OK;
+}
 
+static CorgiStatus
+compile_dfa(Compiler* compiler, CorgiRegexp* regexp)
+{
+    /* makes the lazy DFAs of a pattern. they ignore groups, which another
+       engine finds in a match of them. a pattern which a program cannot run
+       gets no DFA, and the VM runs it */
+    Node* node = compiler->root;
+    if (!compiler->dfa || !is_prog_node(node)) {
+        return CORGI_OK;
+    }
+    CorgiDfa* dfa = (CorgiDfa*)calloc(1, sizeof(CorgiDfa));
+    if (dfa == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiStatus status = compile_prog(compiler, node, FALSE, &dfa->forward.prog);
+    if (status == CORGI_OK) {
+        status = compile_prog(compiler, node, TRUE, &dfa->backward.prog);
+    }
+    if (status == CORGI_OK) {
+        status = init_dfa(&dfa->forward, FALSE);
+    }
+    if (status == CORGI_OK) {
+        status = init_dfa(&dfa->backward, TRUE);
+    }
+    if (status != CORGI_OK) {
+        free_dfa(dfa);
+        return status == PROG_TOO_LARGE ? CORGI_OK : status;
+    }
+    regexp->dfa = dfa;
     return CORGI_OK;
 }
 
 static CorgiStatus
-parse_to_instruction(Compiler* compiler, CorgiChar* begin, CorgiChar* end, Instruction** inst)
+compile_forward(Compiler* compiler, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end)
 {
-    Node* node = NULL; /* gcc dislike uninitialized */
-    CorgiChar* pc = begin;
-    CorgiStatus status = parse_branch(compiler, &pc, end, &node);
+    /* compiles all but the reverse code, keeping the syntax tree */
+    Instruction* inst = NULL;
+    CorgiStatus status = parse_to_instruction(compiler, begin, end, &inst);
     if (status != CORGI_OK) {
         return status;
     }
-    status = node2instruction(compiler, node, inst);
+    CorgiCode* code = NULL;
+    CorgiUInt code_size = 0;
+    status = instruction2code(compiler, inst, &code, &code_size);
     if (status != CORGI_OK) {
         return status;
     }
-    Instruction* success = NULL;
-    status = create_instruction(compiler, INST_SUCCESS, &success);
+    regexp->code = code;
+    regexp->code_size = code_size;
+    regexp->min_width = compiler->min_width;
+    regexp->max_width = compiler->max_width;
+    regexp->anchor = compiler->anchor;
+    status = alloc_required(compiler, regexp);
     if (status != CORGI_OK) {
         return status;
     }
-    Instruction* last = get_last_instruction(*inst);
-    if (last == NULL) {
-        *inst = success;
-        return CORGI_OK;
+    CorgiGroup** groups = NULL;
+    CorgiUInt groups_num = compiler->group_id;
+    status = alloc_groups(compiler, groups_num, &groups);
+    if (status != CORGI_OK) {
+        return status;
     }
-    get_last_instruction(*inst)->next = success;
-    return CORGI_OK;
+    regexp->groups = groups;
+    regexp->groups_num = groups_num;
+    status = compile_dfa(compiler, regexp);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    status = compile_onepass(compiler, regexp);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    status = compile_shift_and(compiler, regexp);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    status = compile_linear(compiler, regexp);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    return compile_bitstate(compiler, regexp);
 }
 
 static CorgiStatus
-alloc_group(Node* node, CorgiGroup** pgroup)
+compile_with_compiler(Compiler* compiler, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end)
 {
-    assert(node->type == NODE_SUBPATTERN);
-    if (node->u.subpattern.begin == NULL) {
-        *pgroup = NULL;
-        return CORGI_OK;
+    CorgiStatus status = compile_forward(compiler, regexp, begin, end);
+    if (status != CORGI_OK) {
+        return status;
     }
-    CorgiGroup* group = (CorgiGroup*)malloc(sizeof(CorgiGroup));
-    if (group == NULL) {
-        return ERR_OUT_OF_MEMORY;
+    return compile_reverse(compiler, regexp);
+}
+
+CorgiStatus
+corgi_compile(CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end, CorgiOptions opts)
+{
+    Compiler compiler;
+    CorgiStatus status = init_compiler(&compiler, opts);
+    if (status != CORGI_OK) {
+        return status;
     }
-    bzero(group, sizeof(*group));
-    *pgroup = group;
-    ptrdiff_t n = node->u.subpattern.end - node->u.subpattern.begin;
-    size_t size = sizeof(CorgiChar) * n;
-    CorgiChar* name = (CorgiChar*)malloc(size);
-    if (name == NULL) {
-        return ERR_OUT_OF_MEMORY;
+    status = compile_with_compiler(&compiler, regexp, begin, end);
+    fini_compiler(&compiler);
+    return status;
+}
+
+/* a set runs the patterns which a program can run by one lazy DFA. the
+   program is SPLIT p1, L2; p1: ...; MATCH 0; L2: SPLIT p2, L3; ...; MATCH n,
+   where MATCH has the index of its pattern */
+struct CorgiSetDfa {
+    struct Dfa dfa;
+    CorgiUInt patterns_num;
+};
+
+typedef struct CorgiSetDfa SetDfa;
+
+#define SET_PROG_SIZE_MAX   (10 * PROG_SIZE_MAX)
+#define SET_CACHE_SIZE      (16 * DFA_CACHE_SIZE)
+
+static void
+free_set_dfa(SetDfa* set_dfa)
+{
+    if (set_dfa == NULL) {
+        return;
     }
-    memcpy(name, node->u.subpattern.begin, size);
-    group->begin = name;
-    group->end = name + n;
-    return CORGI_OK;
+    fini_dfa(&set_dfa->dfa);
+    free(set_dfa);
 }
 
-static CorgiStatus
-alloc_groups(Compiler* compiler, CorgiUInt groups_num, CorgiGroup*** p)
+static void
+prog_truncate(Prog* prog, CorgiUInt size)
 {
-    size_t size = sizeof(CorgiGroup*) * groups_num;
-    CorgiGroup** groups = (CorgiGroup**)malloc(size);
-    if (groups == NULL) {
-        return ERR_OUT_OF_MEMORY;
+    CorgiUInt i;
+    for (i = size; i < prog->size; i++) {
+        free(prog->insts[i].set);
     }
-    bzero(groups, size);
-    CorgiStatus status = CORGI_OK;
-    CorgiUInt i = 0;
-    Node* node = compiler->groups;
-    while ((node != NULL) && (status == CORGI_OK)) {
-        status = alloc_group(node, groups + groups_num - i - 1);
-        i++;
-        node = node->u.subpattern.next;
+    prog->size = size;
+}
+
+static CorgiStatus
+set_add_pattern(Compiler* compiler, Prog* prog, CorgiUInt id, CorgiUInt* last)
+{
+    /* adds SPLIT body, next; body: ...; MATCH id; next:. a pattern which
+       makes the program too large is removed */
+    CorgiUInt size = prog->size;
+    CorgiUInt split;
+    CorgiStatus status = prog_add(prog, PROG_SPLIT, 0, &split);
+    if (status == CORGI_OK) {
+        status = prog_add_nodes(compiler, prog, compiler->root, FALSE);
+    }
+    if (status == CORGI_OK) {
+        status = prog_add(prog, PROG_MATCH, id, NULL);
     }
     if (status != CORGI_OK) {
-        free_groups(groups, groups_num);
+        prog_truncate(prog, size);
         return status;
     }
-    assert(i == groups_num);
-    *p = groups;
+    prog_set_split(prog, split, split + 1, prog->size, TRUE);
+    *last = split;
     return CORGI_OK;
 }
 
 static CorgiStatus
-compile_with_compiler(Compiler* compiler, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end)
+compile_set_pattern(CorgiSet* set, Prog* prog, CorgiUInt id, CorgiChar* begin, CorgiChar* end, CorgiOptions opts, CorgiUInt* last)
 {
-    Instruction* inst = NULL;
-    CorgiStatus status = parse_to_instruction(compiler, begin, end, &inst);
+    Compiler compiler;
+    CorgiStatus status = init_compiler(&compiler, opts);
     if (status != CORGI_OK) {
         return status;
     }
-    CorgiCode* code = NULL;
-    CorgiUInt code_size = 0;
-    status = instruction2code(compiler, inst, &code, &code_size);
-    if (status != CORGI_OK) {
-        return status;
+    CorgiRegexp* regexp = &set->regexps[id];
+    status = compile_forward(&compiler, regexp, begin, end);
+    if (status == CORGI_OK) {
+        status = is_prog_node(compiler.root) ? set_add_pattern(&compiler, prog, id, last) : PROG_TOO_LARGE;
+    }
+    if (status == PROG_TOO_LARGE) {
+        set->others[set->others_num] = id;
+        set->others_num++;
+        status = CORGI_OK;
+    }
+    if (status == CORGI_OK) {
+        status = compile_reverse(&compiler, regexp);
+    }
+    fini_compiler(&compiler);
+    return status;
+}
+
+static CorgiStatus
+compile_set_dfa(CorgiSet* set, SetDfa* set_dfa, CorgiUInt last)
+{
+    /* the last pattern has no next one */
+    Prog* prog = &set_dfa->dfa.prog;
+    prog->insts[last].op = PROG_JUMP;
+    CorgiStatus status = prog_add_search(prog);
+    if (status == CORGI_OK) {
+        status = prog_find_firsts(prog);
+    }
+    set_dfa->dfa.set = TRUE;
+    if (status == CORGI_OK) {
+        status = init_dfa(&set_dfa->dfa, FALSE);
     }
-    regexp->code = code;
-    regexp->code_size = code_size;
-    CorgiGroup** groups = NULL;
-    CorgiUInt groups_num = compiler->group_id;
-    status = alloc_groups(compiler, groups_num, &groups);
     if (status != CORGI_OK) {
         return status;
     }
-    regexp->groups = groups;
-    regexp->groups_num = groups_num;
+    set_dfa->dfa.cache_max = SET_CACHE_SIZE;
+    set_dfa->patterns_num = set->regexps_num - set->others_num;
     return CORGI_OK;
 }
 
 CorgiStatus
-corgi_compile(CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end, CorgiOptions opts)
+corgi_compile_set(CorgiSet* set, CorgiChar** begins, CorgiChar** ends, CorgiUInt num, CorgiOptions opts)
 {
-    Compiler compiler;
-    CorgiStatus status = init_compiler(&compiler, opts & CORGI_OPT_IGNORE_CASE);
-    if (status != CORGI_OK) {
+    if (num == 0) {
+        /* an empty set has no DFA, and matches nothing */
+        set->regexps_num = 0;
+        set->others_num = 0;
+        return CORGI_OK;
+    }
+    CorgiRegexp* regexps = (CorgiRegexp*)malloc(sizeof(CorgiRegexp) * num);
+    CorgiUInt* others = (CorgiUInt*)malloc(sizeof(CorgiUInt) * num);
+    SetDfa* set_dfa = (SetDfa*)calloc(1, sizeof(SetDfa));
+    if ((regexps == NULL) || (others == NULL) || (set_dfa == NULL)) {
+        free(set_dfa);
+        free(others);
+        free(regexps);
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiUInt i;
+    for (i = 0; i < num; i++) {
+        corgi_init_regexp(&regexps[i]);
+    }
+    set->regexps = regexps;
+    set->regexps_num = num;
+    set->others = others;
+    Prog* prog = &set_dfa->dfa.prog;
+    prog->size_max = SET_PROG_SIZE_MAX;
+    prog->ignore_case = opts & CORGI_OPT_IGNORE_CASE ? TRUE : FALSE;
+    CorgiUInt last = 0;
+    CorgiStatus status = CORGI_OK;
+    for (i = 0; (status == CORGI_OK) && (i < num); i++) {
+        status = compile_set_pattern(set, prog, i, begins[i], ends[i], opts, &last);
+    }
+    if ((status == CORGI_OK) && (0 < prog->size)) {
+        status = compile_set_dfa(set, set_dfa, last);
+    }
+    if ((status != CORGI_OK) || (prog->size == 0)) {
+        free_set_dfa(set_dfa);
         return status;
     }
-    status = compile_with_compiler(&compiler, regexp, begin, end);
-    fini_compiler(&compiler);
-    return status;
+    set->dfa = set_dfa;
+    return CORGI_OK;
 }
 
 typedef CorgiInt (*Proc)(State*, CorgiCode*);
@@ -2827,6 +8884,10 @@ do_with_state(State* state, CorgiMatch* match, CorgiRegexp* regexp, Proc proc)
     if (ret == 0) {
         return CORGI_MISMATCH;
     }
+    if (ret < 0) {
+        /* the VM failed. it is not a match */
+        return ret == SRE_ERROR_MEMORY ? ERR_OUT_OF_MEMORY : ERR_INVALID_STATE;
+    }
     size_t size = sizeof(CorgiRange) * regexp->groups_num;
     CorgiRange* groups = (CorgiRange*)malloc(size);
     if (groups == NULL) {
@@ -2847,6 +8908,10 @@ do_with_state(State* state, CorgiMatch* match, CorgiRegexp* regexp, Proc proc)
 static CorgiStatus
 corgi_main(CorgiMatch* match, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end, CorgiChar* at, CorgiOptions opts, Proc proc)
 {
+    if ((CorgiUInt)(end - at) < regexp->min_width) {
+        /* the rest of the string is too short for any match */
+        return CORGI_MISMATCH;
+    }
     State state;
     state_init(&state, regexp, begin, end, at, opts & CORGI_OPT_DEBUG);
     CorgiStatus status = do_with_state(&state, match, regexp, proc);
@@ -2854,9 +8919,178 @@ corgi_main(CorgiMatch* match, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar*
     return status;
 }
 
+static CorgiStatus pike_main(CorgiMatch*, CorgiRegexp*, CorgiChar*, CorgiChar*, CorgiChar*, Bool);
+static CorgiStatus bitstate_main(CorgiMatch*, CorgiRegexp*, CorgiChar*, CorgiChar*, CorgiChar*, Bool);
+static Bool uses_bitstate(CorgiRegexp*, CorgiChar*, CorgiChar*);
+static CorgiStatus onepass_main(CorgiMatch*, CorgiRegexp*, CorgiChar*, CorgiChar*, CorgiChar*);
+
+static CorgiStatus
+dfa_main(CorgiMatch* match, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end, CorgiChar* at, Bool anchored, CorgiOptions opts)
+{
+    /* the forward DFA finds the end of a match, and then the backward one
+       finds its beginning. groups are found by matching once more from
+       there, so the other positions cost no captures */
+    if ((CorgiUInt)(end - at) < regexp->min_width) {
+        return CORGI_MISMATCH;
+    }
+    CorgiDfa* dfa = regexp->dfa;
+    CorgiChar* match_end;
+    CorgiStatus status = dfa_search_forward(&dfa->forward, regexp, begin, end, at, anchored, &match_end);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    if (match_end == NULL) {
+        return CORGI_MISMATCH;
+    }
+    CorgiChar* match_begin = at;
+    if (!anchored) {
+        status = dfa_search_backward(&dfa->backward, begin, end, at, match_end, &match_begin);
+        if (status != CORGI_OK) {
+            return status;
+        }
+        assert(match_begin != NULL);
+    }
+    if (0 < regexp->groups_num) {
+        if (regexp->onepass != NULL) {
+            return onepass_main(match, regexp, begin, end, match_begin);
+        }
+        if (regexp->prog != NULL) {
+            return pike_main(match, regexp, begin, end, match_begin, TRUE);
+        }
+        if (uses_bitstate(regexp, match_begin, end)) {
+            return bitstate_main(match, regexp, begin, end, match_begin, TRUE);
+        }
+        return corgi_main(match, regexp, begin, end, match_begin, opts, sre_match);
+    }
+    match->regexp = regexp;
+    match->begin = match_begin - begin;
+    match->end = match_end - begin;
+    match->groups = NULL;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+prog_set_match(CorgiMatch* match, CorgiRegexp* regexp, CorgiInt* matched, CorgiInt match_end)
+{
+    /* gives a match of a program with its captures */
+    CorgiUInt groups_num = regexp->groups_num;
+    CorgiRange* groups = (CorgiRange*)malloc(sizeof(CorgiRange) * groups_num);
+    if (groups == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiInt lastindex = matched[PROG_LASTINDEX(groups_num)];
+    CorgiInt i;
+    for (i = 0; i < groups_num; i++) {
+        /* the same as set_group_range() */
+        Bool b = (i < lastindex) && (0 <= matched[2 * i]) && (0 <= matched[2 * i + 1]);
+        groups[i].begin = b ? matched[2 * i] : -1;
+        groups[i].end = b ? matched[2 * i + 1] : -1;
+    }
+    match->regexp = regexp;
+    match->begin = matched[PROG_BEGIN(groups_num)];
+    match->end = match_end;
+    match->groups = groups;
+    return CORGI_OK;
+}
+
+static CorgiStatus
+pike_main(CorgiMatch* match, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end, CorgiChar* at, Bool anchored)
+{
+    if ((CorgiUInt)(end - at) < regexp->min_width) {
+        return CORGI_MISMATCH;
+    }
+    Pike pike;
+    CorgiStatus status = init_pike(&pike, regexp->prog, regexp->groups_num, begin, end);
+    CorgiChar* match_end = NULL;
+    if (status == CORGI_OK) {
+        status = pike_search(&pike, regexp, at, anchored, &match_end);
+    }
+    if ((status == CORGI_OK) && (match_end == NULL)) {
+        status = CORGI_MISMATCH;
+    }
+    if (status == CORGI_OK) {
+        status = prog_set_match(match, regexp, pike.matched, match_end - begin);
+    }
+    fini_pike(&pike);
+    return status;
+}
+
+static CorgiStatus
+bitstate_main(CorgiMatch* match, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end, CorgiChar* at, Bool anchored)
+{
+    if ((CorgiUInt)(end - at) < regexp->min_width) {
+        return CORGI_MISMATCH;
+    }
+    if (regexp->anchor == CORGI_ANCHOR_STRING) {
+        /* like sre_search_string() */
+        if (at != begin) {
+            return CORGI_MISMATCH;
+        }
+        anchored = TRUE;
+    }
+    BitState bitstate;
+    CorgiStatus status = init_bitstate(&bitstate, regexp->bitstate, regexp->groups_num, begin, end, at);
+    CorgiInt match_end = -1;
+    if (status == CORGI_OK) {
+        status = bitstate_search(&bitstate, regexp, anchored, &match_end);
+    }
+    if ((status == CORGI_OK) && (match_end < 0)) {
+        status = CORGI_MISMATCH;
+    }
+    if (status == CORGI_OK) {
+        status = prog_set_match(match, regexp, bitstate.caps, match_end);
+    }
+    fini_bitstate(&bitstate);
+    return status;
+}
+
+static Bool
+uses_bitstate(CorgiRegexp* regexp, CorgiChar* at, CorgiChar* end)
+{
+    return (regexp->bitstate != NULL) && bitstate_fits(regexp->bitstate, at, end);
+}
+
+static CorgiStatus
+onepass_main(CorgiMatch* match, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end, CorgiChar* at)
+{
+    if ((CorgiUInt)(end - at) < regexp->min_width) {
+        return CORGI_MISMATCH;
+    }
+    CorgiUInt caps_num = PROG_CAPS_NUM(regexp->groups_num);
+    CorgiInt* caps = (CorgiInt*)malloc(sizeof(CorgiInt) * 2 * caps_num);
+    if (caps == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiInt* matched = caps + caps_num;
+    CorgiInt match_end;
+    onepass_match(regexp->onepass, regexp->groups_num, begin, end, at, caps, matched, &match_end);
+    CorgiStatus status = CORGI_MISMATCH;
+    if (0 <= match_end) {
+        status = prog_set_match(match, regexp, matched, match_end);
+    }
+    free(caps);
+    return status;
+}
+
 CorgiStatus
 corgi_match(CorgiMatch* match, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end, CorgiChar* at, CorgiOptions opts)
 {
+    if ((regexp->dfa != NULL) && (regexp->groups_num == 0)) {
+        return dfa_main(match, regexp, begin, end, at, TRUE, opts);
+    }
+    if (regexp->onepass != NULL) {
+        return onepass_main(match, regexp, begin, end, at);
+    }
+    if (regexp->prog != NULL) {
+        return pike_main(match, regexp, begin, end, at, TRUE);
+    }
+    if (regexp->dfa != NULL) {
+        /* the VM runs only when there is a match */
+        return dfa_main(match, regexp, begin, end, at, TRUE, opts);
+    }
+    if (uses_bitstate(regexp, at, end)) {
+        return bitstate_main(match, regexp, begin, end, at, TRUE);
+    }
     return corgi_main(match, regexp, begin, end, at, opts, sre_match);
 }
 
@@ -2930,6 +9164,90 @@ category_type2name(CorgiCode type)
     }
 }
 
+static Bool
+is_in_bitmap(CorgiCode op, CorgiCode* set, CorgiChar c)
+{
+    if (op == SRE_OP_ASCII_BITMAP) {
+        return (c < 128) && SRE_IS_IN_ASCII_BITMAP((const unsigned char*)set, c) ? TRUE : FALSE;
+    }
+    if (op == SRE_OP_CHARSET) {
+        return (c < 256) && (set[c >> 5] & ((CorgiCode)1 << (c & 31))) ? TRUE : FALSE;
+    }
+    CorgiUInt block = ((unsigned char*)set)[c >> 8];
+    CorgiCode* blocks = set + BLOCKS_NUM / sizeof(CorgiCode);
+    return blocks[BLOCK_WORDS * block + ((c & 255) >> 5)] & ((CorgiCode)1 << (c & 31)) ? TRUE : FALSE;
+}
+
+static void
+print_bitmap(CorgiCode op, CorgiCode* set)
+{
+    /* set points the bitmap of ASCII_BITMAP or CHARSET, or the block indices
+       of BIGCHARSET */
+    CorgiChar limit = op == SRE_OP_ASCII_BITMAP ? 128 : op == SRE_OP_CHARSET ? 256 : 65536;
+    const char* sep = "";
+    CorgiChar c = 0;
+    while (c < limit) {
+        if (!is_in_bitmap(op, set, c)) {
+            c++;
+            continue;
+        }
+        CorgiChar low = c;
+        while ((c < limit) && is_in_bitmap(op, set, c)) {
+            c++;
+        }
+        if (low == c - 1) {
+            printf("%s%u", sep, low);
+        }
+        else {
+            printf("%s%u-%u", sep, low, c - 1);
+        }
+        sep = " ";
+    }
+}
+
+static void
+dump_info(Instruction* inst)
+{
+    CorgiUInt flags = inst->u.info.flags;
+    printf("INFO %04zu %zu %5zu %5zu", inst->u.info.dest->pos, flags, inst->u.info.min, inst->u.info.max);
+    if (flags & SRE_INFO_CHARSET) {
+        printf(" CHARSET");
+    }
+    if ((flags & SRE_INFO_PREFIX) == 0) {
+        if (flags & SRE_INFO_IGNORE) {
+            printf(" IGNORE");
+        }
+        return;
+    }
+    printf(" PREFIX %zu \"", inst->u.info.prefix_skip);
+    CorgiUInt i;
+    for (i = 0; i < inst->u.info.prefix_len; i++) {
+        printf("%c", char2printable(inst->u.info.prefix[i]));
+    }
+    printf("\"");
+    if (flags & SRE_INFO_LITERAL) {
+        printf(" LITERAL");
+    }
+    if (flags & SRE_INFO_IGNORE) {
+        printf(" IGNORE");
+    }
+    if (flags & SRE_INFO_SKIP) {
+        printf(" SKIP");
+    }
+}
+
+static void
+dump_literal_string(Instruction* inst)
+{
+    const char* name = inst->type == INST_LITERAL_STRING ? "LITERAL_STRING" : "LITERAL_STRING_IGNORE";
+    printf("%s %zu \"", name, inst->u.literal_string.len);
+    CorgiUInt i;
+    for (i = 0; i < inst->u.literal_string.len; i++) {
+        printf("%c", char2printable(inst->u.literal_string.s[i]));
+    }
+    printf("\"");
+}
+
 static void
 dump_instruction(Instruction* inst)
 {
@@ -2950,6 +9268,16 @@ dump_instruction(Instruction* inst)
         type = inst->u.at.type;
         printf("AT %u (%s)", type, at_type2name(type));
         break;
+    case INST_ASCII_BITMAP:
+        printf("ASCII_BITMAP");
+        break;
+    case INST_ATOMIC_GROUP:
+        printf("ATOMIC_GROUP %04zu", inst->u.atomic_group.dest->pos);
+        break;
+    case INST_BIGCHARSET:
+        printf("BIGCHARSET %zu ", inst->u.bigcharset.count);
+        print_bitmap(SRE_OP_BIGCHARSET, inst->u.bigcharset.data);
+        break;
     case INST_BRANCH:
         printf("BRANCH");
         break;
@@ -2957,12 +9285,22 @@ dump_instruction(Instruction* inst)
         type = inst->u.category.type;
         printf("CATEGORY %u (%s)", type, category_type2name(type));
         break;
+    case INST_CHARSET:
+        printf("CHARSET ");
+        print_bitmap(SRE_OP_CHARSET, inst->u.charset.bits);
+        break;
     case INST_FAILURE:
         printf("FAILURE");
         break;
     case INST_IN:
         printf("IN %zu", inst->u.in.dest->pos);
         break;
+    case INST_IN_IGNORE:
+        printf("IN_IGNORE %zu", inst->u.in.dest->pos);
+        break;
+    case INST_INFO:
+        dump_info(inst);
+        break;
     case INST_JUMP:
         printf("JUMP %zu", inst->u.jump.dest->pos);
         break;
@@ -2973,6 +9311,14 @@ dump_instruction(Instruction* inst)
         c = inst->u.literal.c;
         printf("LITERAL %8u (%c)", c, char2printable(c));
         break;
+    case INST_LITERAL_IGNORE:
+        c = inst->u.literal.c;
+        printf("LITERAL_IGNORE %8u (%c)", c, char2printable(c));
+        break;
+    case INST_LITERAL_STRING:
+    case INST_LITERAL_STRING_IGNORE:
+        dump_literal_string(inst);
+        break;
     case INST_MARK:
         printf("MARK %zu", inst->u.mark.id);
         break;
@@ -2985,6 +9331,14 @@ dump_instruction(Instruction* inst)
     case INST_NEGATE:
         printf("NEGATE");
         break;
+    case INST_NOT_LITERAL:
+        c = inst->u.literal.c;
+        printf("NOT_LITERAL %8u (%c)", c, char2printable(c));
+        break;
+    case INST_NOT_LITERAL_IGNORE:
+        c = inst->u.literal.c;
+        printf("NOT_LITERAL_IGNORE %8u (%c)", c, char2printable(c));
+        break;
     case INST_OFFSET:
         printf("OFFSET %04zu", inst->u.offset.dest->pos);
         break;
@@ -2996,6 +9350,18 @@ dump_instruction(Instruction* inst)
     case INST_REPEAT:
         printf("REPEAT %04zu %5zu %5zu", inst->u.repeat.dest->pos, inst->u.repeat.min, inst->u.repeat.max);
         break;
+    case INST_REPEAT_ONE:
+        printf("REPEAT_ONE %04zu %5zu %5zu", inst->u.repeat.dest->pos, inst->u.repeat.min, inst->u.repeat.max);
+        break;
+    case INST_MIN_REPEAT_ONE:
+        printf("MIN_REPEAT_ONE %04zu %5zu %5zu", inst->u.repeat.dest->pos, inst->u.repeat.min, inst->u.repeat.max);
+        break;
+    case INST_POSSESSIVE_REPEAT:
+        printf("POSSESSIVE_REPEAT %04zu %5zu %5zu", inst->u.repeat.dest->pos, inst->u.repeat.min, inst->u.repeat.max);
+        break;
+    case INST_POSSESSIVE_REPEAT_ONE:
+        printf("POSSESSIVE_REPEAT_ONE %04zu %5zu %5zu", inst->u.repeat.dest->pos, inst->u.repeat.min, inst->u.repeat.max);
+        break;
     case INST_SUCCESS:
         printf("SUCCESS");
         break;
@@ -3026,7 +9392,7 @@ CorgiStatus
 corgi_dump(CorgiChar* begin, CorgiChar* end, CorgiOptions opts)
 {
     Compiler compiler;
-    init_compiler(&compiler, opts & CORGI_OPT_IGNORE_CASE);
+    init_compiler(&compiler, opts);
     CorgiStatus status = dump_with_compiler(&compiler, begin, end);
     fini_compiler(&compiler);
     return status;
@@ -3049,6 +9415,9 @@ disassemble_opcode(int pos, CorgiCode opcode)
     case SRE_OP_ANY_ALL:
         name = "ANY_ALL";
         break;
+    case SRE_OP_ASCII_BITMAP:
+        name = "ASCII_BITMAP";
+        break;
     case SRE_OP_ASSERT:
         name = "ASSERT";
         break;
@@ -3133,6 +9502,21 @@ disassemble_opcode(int pos, CorgiCode opcode)
     case SRE_OP_MIN_REPEAT_ONE:
         name = "MIN_REPEAT_ONE";
         break;
+    case SRE_OP_LITERAL_STRING:
+        name = "LITERAL_STRING";
+        break;
+    case SRE_OP_LITERAL_STRING_IGNORE:
+        name = "LITERAL_STRING_IGNORE";
+        break;
+    case SRE_OP_ATOMIC_GROUP:
+        name = "ATOMIC_GROUP";
+        break;
+    case SRE_OP_POSSESSIVE_REPEAT:
+        name = "POSSESSIVE_REPEAT";
+        break;
+    case SRE_OP_POSSESSIVE_REPEAT_ONE:
+        name = "POSSESSIVE_REPEAT_ONE";
+        break;
     default:
         name = "UNKNOWN";
         break;
@@ -3162,6 +9546,62 @@ disassemble_branch(CorgiCode** p, CorgiCode* base)
     }
 }
 
+static void
+disassemble_info(CorgiCode** p, CorgiCode* base)
+{
+    /* <INFO> <skip> <flags> <min> <max> [<length> <skip> <prefix> <overlap>] */
+    CorgiCode offset = **p;
+    CorgiCode* end = *p + offset;
+    CorgiCode flags = (*p)[1];
+    printf("%u %u %u %u\n", offset, flags, (*p)[2], (*p)[3]);
+    *p += 4;
+    if (flags & SRE_INFO_PREFIX) {
+        CorgiCode len = (*p)[0];
+        printf("%04tu (prefix) %u %u\n", *p - base, len, (*p)[1]);
+        *p += 2;
+        CorgiUInt i;
+        for (i = 0; i < len; i++) {
+            CorgiCode c = (*p)[i];
+            printf("%04tu (prefix) %8u (%c)\n", *p - base + i, c, char2printable(c));
+        }
+        printf("%04tu (overlap)", *p - base + len);
+        for (i = 0; i < len; i++) {
+            printf(" %u", (*p)[len + i]);
+        }
+        printf("\n");
+        if (flags & SRE_INFO_SKIP) {
+            /* shows only entries which differ from the prefix length */
+            CorgiCode* skip = *p + 2 * len;
+            printf("%04tu (skip)", skip - base);
+            for (i = 0; i < SRE_SKIP_TABLE_SIZE; i++) {
+                if (skip[i] != len) {
+                    printf(" %zu:%u", i, skip[i]);
+                }
+            }
+            printf("\n");
+        }
+    }
+    else if (flags & SRE_INFO_CHARSET) {
+        disassemble_pattern(p, base, end);
+    }
+    *p = end;
+}
+
+static void
+disassemble_literal_string(CorgiCode** p, CorgiCode* base)
+{
+    /* <LITERAL_STRING> <length> <codes> */
+    CorgiCode len = **p;
+    printf("%u\n", len);
+    (*p)++;
+    CorgiUInt i;
+    for (i = 0; i < len; i++) {
+        CorgiCode c = (*p)[i];
+        printf("%04tu (string) %8u (%c)\n", *p - base + i, c, char2printable(c));
+    }
+    *p += len;
+}
+
 static void
 disassemble_code(CorgiCode** p, CorgiCode* base)
 {
@@ -3194,6 +9634,13 @@ disassemble_code(CorgiCode** p, CorgiCode* base)
         printf("%u\n", **p);
         (*p)++;
         break;
+    case SRE_OP_ATOMIC_GROUP:
+        offset = **p;
+        end = *p + offset;
+        printf("%u\n", offset);
+        (*p)++;
+        disassemble_pattern(p, base, end);
+        break;
     case SRE_OP_BRANCH:
         printf("\n");
         disassemble_branch(p, base);
@@ -3209,9 +9656,21 @@ disassemble_code(CorgiCode** p, CorgiCode* base)
         printf("%u (%s)\n", **p, category_type2name(**p));
         (*p)++;
         break;
+    case SRE_OP_ASCII_BITMAP:
+        print_bitmap(operand, *p);
+        printf("\n");
+        *p += SRE_ASCII_BITMAP_WORDS;
+        break;
     case SRE_OP_CHARSET:
+        print_bitmap(operand, *p);
+        printf("\n");
+        *p += BLOCK_WORDS;
+        break;
     case SRE_OP_BIGCHARSET:
+        printf("%u ", **p);
+        print_bitmap(operand, *p + 1);
         printf("\n");
+        *p += 1 + BLOCKS_NUM / sizeof(CorgiCode) + BLOCK_WORDS * **p;
         break;
     case SRE_OP_GROUPREF:
     case SRE_OP_GROUPREF_IGNORE:
@@ -3238,11 +9697,7 @@ disassemble_code(CorgiCode** p, CorgiCode* base)
         disassemble_pattern(p, base, end);
         break;
     case SRE_OP_INFO:
-        offset = **p;
-        end = *p + offset;
-        printf("%u\n", offset);
-        printf("...(snip)...\n");
-        *p = end;
+        disassemble_info(p, base);
         break;
     case SRE_OP_JUMP:
         offset = **p;
@@ -3257,6 +9712,10 @@ disassemble_code(CorgiCode** p, CorgiCode* base)
         printf("%8u (%c)\n", c, isprint(c) ? c : ' ');
         (*p)++;
         break;
+    case SRE_OP_LITERAL_STRING:
+    case SRE_OP_LITERAL_STRING_IGNORE:
+        disassemble_literal_string(p, base);
+        break;
     case SRE_OP_MARK:
         printf("%u\n", **p);
         (*p)++;
@@ -3277,6 +9736,8 @@ disassemble_code(CorgiCode** p, CorgiCode* base)
     case SRE_OP_REPEAT:
     case SRE_OP_REPEAT_ONE:
     case SRE_OP_MIN_REPEAT_ONE:
+    case SRE_OP_POSSESSIVE_REPEAT:
+    case SRE_OP_POSSESSIVE_REPEAT_ONE:
         offset = **p;
         end = *p + offset;
         printf("%u ", offset);
@@ -3305,9 +9766,109 @@ corgi_disassemble(CorgiRegexp* regexp)
 CorgiStatus
 corgi_search(CorgiMatch* match, CorgiRegexp* regexp, CorgiChar* begin, CorgiChar* end, CorgiChar* at, CorgiOptions opts)
 {
+    /* a match of \A... starts only at at */
+    Bool anchored = regexp->anchor == CORGI_ANCHOR_STRING;
+    if (regexp->dfa != NULL) {
+        return dfa_main(match, regexp, begin, end, at, anchored, opts);
+    }
+    if (regexp->prog != NULL) {
+        return pike_main(match, regexp, begin, end, at, anchored);
+    }
+    if (uses_bitstate(regexp, at, end)) {
+        return bitstate_main(match, regexp, begin, end, at, anchored);
+    }
+    switch (regexp->anchor) {
+    case CORGI_ANCHOR_STRING:
+        return corgi_main(match, regexp, begin, end, at, opts, sre_search_string);
+    case CORGI_ANCHOR_LINE:
+        return corgi_main(match, regexp, begin, end, at, opts, sre_search_line);
+    default:
+        break;
+    }
+    if (regexp->reverse_code != NULL) {
+        return corgi_main(match, regexp, begin, end, at, opts, sre_search_reverse);
+    }
+    if (regexp->shift_and != NULL) {
+        return corgi_main(match, regexp, begin, end, at, opts, sre_search_shift_and);
+    }
+    if (regexp->required != NULL) {
+        return corgi_main(match, regexp, begin, end, at, opts, sre_search_required);
+    }
     return corgi_main(match, regexp, begin, end, at, opts, sre_search);
 }
 
+CorgiStatus
+corgi_init_set(CorgiSet* set)
+{
+    bzero(set, sizeof(*set));
+    return CORGI_OK;
+}
+
+CorgiStatus
+corgi_fini_set(CorgiSet* set)
+{
+    CorgiUInt i;
+    for (i = 0; i < set->regexps_num; i++) {
+        corgi_fini_regexp(&set->regexps[i]);
+    }
+    free(set->regexps);
+    free(set->others);
+    free_set_dfa(set->dfa);
+    return CORGI_OK;
+}
+
+static CorgiStatus
+search_set_others(CorgiSet* set, CorgiChar* begin, CorgiChar* end, CorgiChar* at, CorgiOptions opts, Bool* matched)
+{
+    CorgiUInt i;
+    for (i = 0; i < set->others_num; i++) {
+        CorgiUInt id = set->others[i];
+        CorgiMatch match;
+        corgi_init_match(&match);
+        CorgiStatus status = corgi_search(&match, &set->regexps[id], begin, end, at, opts);
+        corgi_fini_match(&match);
+        if (status == CORGI_OK) {
+            matched[id] = TRUE;
+        }
+        else if (status != CORGI_MISMATCH) {
+            return status;
+        }
+    }
+    return CORGI_OK;
+}
+
+CorgiStatus
+corgi_search_set(CorgiSet* set, CorgiChar* begin, CorgiChar* end, CorgiChar* at, CorgiUInt* ids, CorgiUInt* ids_num, CorgiOptions opts)
+{
+    /* ids gets the indexes of the matching patterns in ascending order */
+    *ids_num = 0;
+    Bool* matched = (Bool*)calloc(set->regexps_num + 1, sizeof(Bool));
+    if (matched == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    CorgiStatus status = CORGI_OK;
+    SetDfa* set_dfa = set->dfa;
+    if (set_dfa != NULL) {
+        CorgiUInt matched_num = 0;
+        status = dfa_search_set(&set_dfa->dfa, begin, end, at, matched, &matched_num, set_dfa->patterns_num);
+    }
+    if (status == CORGI_OK) {
+        status = search_set_others(set, begin, end, at, opts, matched);
+    }
+    CorgiUInt i;
+    for (i = 0; (status == CORGI_OK) && (i < set->regexps_num); i++) {
+        if (matched[i]) {
+            ids[*ids_num] = i;
+            (*ids_num)++;
+        }
+    }
+    free(matched);
+    if (status != CORGI_OK) {
+        return status;
+    }
+    return 0 < *ids_num ? CORGI_OK : CORGI_MISMATCH;
+}
+
 static Bool
 compare_group_name(CorgiChar* begin, CorgiChar* end, CorgiGroup* group)
 {
@@ -23,9 +23,14 @@ typedef CorgiUInt Bool;
 
 struct Options {
     Bool debug;
+    Bool dfa;
     CorgiUInt group_id;
     const char* group_name;
     Bool ignore_case;
+    Bool linear;
+    Bool no_capture;
+    Bool position;
+    Bool unoptimized;
 };
 
 typedef struct Options Options;
@@ -37,8 +42,13 @@ usage()
     puts("");
     puts("OPTIONS:");
     puts("  --debug, -d: Enable debugging");
+    puts("  --dfa, -D: Search by lazy DFAs");
     puts("  --group-id, -g: Group number to show");
     puts("  --help, -h: Show this message");
+    puts("  --linear, -L: Search by the Pike VM");
+    puts("  --no-capture, -n: Compile groups without capturing");
+    puts("  --position, -p: Show the beginning and the end instead of a string");
+    puts("  --unoptimized, -u: Compile without optimizations");
     puts("  --version, -v: Show version information and exit");
     puts("");
     puts("COMMAND:");
@@ -46,6 +56,7 @@ usage()
     puts("  dump <regexp>");
     puts("  match <regexp> <string>");
     puts("  search <regexp> <string>");
+    puts("  set <regexp>... <string>");
 }
 
 static int
@@ -200,6 +211,28 @@ get_group_id(CorgiRegexp* regexp, Options* opts, CorgiUInt* group_id)
     return CORGI_OK;
 }
 
+static CorgiOptions
+get_compile_options(Options* opts)
+{
+    CorgiOptions corgi_opts = 0;
+    if (opts->ignore_case) {
+        corgi_opts |= CORGI_OPT_IGNORE_CASE;
+    }
+    if (opts->no_capture) {
+        corgi_opts |= CORGI_OPT_NO_CAPTURE;
+    }
+    if (opts->unoptimized) {
+        corgi_opts |= CORGI_OPT_NO_OPTIMIZE;
+    }
+    if (opts->dfa) {
+        corgi_opts |= CORGI_OPT_DFA;
+    }
+    if (opts->linear) {
+        corgi_opts |= CORGI_OPT_LINEAR;
+    }
+    return corgi_opts;
+}
+
 typedef CorgiStatus (*Worker)(CorgiMatch*, CorgiRegexp*, CorgiChar*, CorgiChar*, CorgiChar*, CorgiOptions);
 
 static CorgiStatus
@@ -234,7 +267,15 @@ work_with_match(CorgiRegexp* regexp, CorgiMatch* match, Options* opts, const cha
         matched_end = match->end;
     }
     else {
-        corgi_get_group_range(match, group_id - 1, &matched_begin, &matched_end);
+        status = corgi_get_group_range(match, group_id - 1, &matched_begin, &matched_end);
+        if (status != CORGI_OK) {
+            print_error("Can't get group range", status);
+            return 1;
+        }
+    }
+    if (opts->position) {
+        printf("%ld %ld", (long)matched_begin, (long)matched_end);
+        return 0;
     }
     if (matched_begin < 0) {
         return 0;
@@ -253,11 +294,7 @@ work_with_regexp(CorgiRegexp* regexp, Options* opts, const char* s, const char*
     CorgiChar* begin = (CorgiChar*)alloca(sizeof(CorgiChar) * size);
     conv_utf8_to_utf32(begin, s);
     CorgiChar* end = begin + size;
-    CorgiOptions corgi_opts = 0;
-    if (opts->ignore_case) {
-        corgi_opts |= CORGI_OPT_IGNORE_CASE;
-    }
-    CorgiStatus status = corgi_compile(regexp, begin, end, corgi_opts);
+    CorgiStatus status = corgi_compile(regexp, begin, end, get_compile_options(opts));
     if (status != CORGI_OK) {
         print_error("Compile failed", status);
         return 1;
@@ -284,6 +321,62 @@ work_main(Options* opts, int argc, char* argv[], Worker f)
     return ret;
 }
 
+static int
+set_with_set(CorgiSet* set, Options* opts, int argc, char* argv[])
+{
+    int num = argc - 1;
+    CorgiChar** begins = (CorgiChar**)alloca(sizeof(CorgiChar*) * num);
+    CorgiChar** ends = (CorgiChar**)alloca(sizeof(CorgiChar*) * num);
+    int i;
+    for (i = 0; i < num; i++) {
+        int size = count_chars(argv[i]);
+        begins[i] = (CorgiChar*)alloca(sizeof(CorgiChar) * size);
+        conv_utf8_to_utf32(begins[i], argv[i]);
+        ends[i] = begins[i] + size;
+    }
+    CorgiStatus status = corgi_compile_set(set, begins, ends, num, get_compile_options(opts));
+    if (status != CORGI_OK) {
+        print_error("Compile failed", status);
+        return 1;
+    }
+
+    const char* t = argv[num];
+    int target_size = count_chars(t);
+    CorgiChar* target = (CorgiChar*)alloca(sizeof(CorgiChar) * target_size);
+    conv_utf8_to_utf32(target, t);
+    CorgiChar* end = target + target_size;
+    CorgiUInt* ids = (CorgiUInt*)alloca(sizeof(CorgiUInt) * num);
+    CorgiUInt ids_num;
+    CorgiOptions corgi_opts = opts->debug ? CORGI_OPT_DEBUG : 0;
+    status = corgi_search_set(set, target, end, target, ids, &ids_num, corgi_opts);
+    if (status == CORGI_MISMATCH) {
+        return 1;
+    }
+    if (status != CORGI_OK) {
+        print_error("Search failed", status);
+        return 1;
+    }
+    CorgiUInt j;
+    for (j = 0; j < ids_num; j++) {
+        printf(j == 0 ? "%zu" : " %zu", ids[j]);
+    }
+    return 0;
+}
+
+static int
+set_main(Options* opts, int argc, char* argv[])
+{
+    if (argc < 1) {
+        usage();
+        return 1;
+    }
+    CorgiSet set;
+    corgi_init_set(&set);
+    int ret = set_with_set(&set, opts, argc, argv);
+    corgi_fini_set(&set);
+    return ret;
+}
+
 static int
 dump_main(Options* opts, int argc, char* argv[])
 {
@@ -294,11 +387,7 @@ dump_main(Options* opts, int argc, char* argv[])
     int size = count_chars(argv[0]);
     CorgiChar* re = alloca(sizeof(CorgiChar) * size);
     conv_utf8_to_utf32(re, argv[0]);
-    CorgiOptions corgi_opts = 0;
-    if (opts->ignore_case) {
-        corgi_opts |= CORGI_OPT_IGNORE_CASE;
-    }
-    if (corgi_dump(re, re + size, corgi_opts) != CORGI_OK) {
+    if (corgi_dump(re, re + size, get_compile_options(opts)) != CORGI_OK) {
         return 1;
     }
     return 0;
@@ -311,11 +400,7 @@ disassemble_with_regexp(Options* opts, CorgiRegexp* regexp, const char* s)
     CorgiChar* begin = (CorgiChar*)alloca(sizeof(CorgiChar) * size);
     conv_utf8_to_utf32(begin, s);
     CorgiChar* end = begin + size;
-    CorgiOptions corgi_opts = 0;
-    if (opts->ignore_case) {
-        corgi_opts |= CORGI_OPT_IGNORE_CASE;
-    }
-    if (corgi_compile(regexp, begin, end, corgi_opts) != CORGI_OK) {
+    if (corgi_compile(regexp, begin, end, get_compile_options(opts)) != CORGI_OK) {
         return 1;
     }
     if (corgi_disassemble(regexp) != CORGI_OK) {
@@ -352,6 +437,9 @@ corgi_main(Options* opts, int argc, char* argv[])
         Worker f = strcmp(cmd, "search") == 0 ? corgi_search : corgi_match;
         return work_main(opts, cmd_argc, cmd_argv, f);
     }
+    if (strcmp(cmd, "set") == 0) {
+        return set_main(opts, cmd_argc, cmd_argv);
+    }
     if (strcmp(cmd, "dump") == 0) {
         return dump_main(opts, cmd_argc, cmd_argv);
     }
@@ -367,10 +455,15 @@ main(int argc, char* argv[])
 {
     struct option longopts[] = {
         { "debug", no_argument, NULL, 'd' },
+        { "dfa", no_argument, NULL, 'D' },
         { "group-id", required_argument, NULL, 'g' },
         { "group-name", required_argument, NULL, 'G' },
         { "help", no_argument, NULL, 'h' },
         { "ignore-case", no_argument, NULL, 'i' },
+        { "linear", no_argument, NULL, 'L' },
+        { "no-capture", no_argument, NULL, 'n' },
+        { "position", no_argument, NULL, 'p' },
+        { "unoptimized", no_argument, NULL, 'u' },
         { "version", no_argument, NULL, 'v' },
         { 0, 0, 0, 0 },
     };
@@ -378,13 +471,19 @@ main(int argc, char* argv[])
     bzero(&opts, sizeof(Options));
     int opt;
     char* s;
-    while ((opt = getopt_long(argc, argv, "Gdg:hiv", longopts, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "DGLdg:hinpuv", longopts, NULL)) != -1) {
         switch (opt) {
+        case 'D':
+            opts.dfa = TRUE;
+            break;
         case 'G':
             s = (char*)alloca(strlen(optarg) + 1);
             strcpy(s, optarg);
             opts.group_name = s;
             break;
+        case 'L':
+            opts.linear = TRUE;
+            break;
         case 'd':
             opts.debug = TRUE;
             break;
@@ -397,6 +496,15 @@ main(int argc, char* argv[])
         case 'i':
             opts.ignore_case = TRUE;
             break;
+        case 'n':
+            opts.no_capture = TRUE;
+            break;
+        case 'p':
+            opts.position = TRUE;
+            break;
+        case 'u':
+            opts.unoptimized = TRUE;
+            break;
         case 'v':
             printf("corgi %s\n", CORGI_PACKAGE_VERSION);
             return 0;
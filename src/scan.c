@@ -0,0 +1,250 @@
+/*
+   Character scanning kernels.
+
+   Every kernel returns the first position in [ptr, end) where a character
+   is (or is not) one of up to three characters, or end if there is none.
+   The ASCII kernels look a character up in a nibble table instead, and
+   also stop at the first non-ASCII character.
+
+   x86 processors get SSE2/SSSE3/AVX2 versions which test 4/8 characters
+   at once. The versions are chosen at the first call from what the
+   processor supports. Other processors use the scalar ones.
+
+   There is no AVX-512 version on purpose. It finds a character about 1.3
+   times as fast as AVX2 in long text, and no faster in lines of a few dozen
+   characters, but 512-bit instructions lower the clock of many Xeons for a
+   while, which slows down the rest of the program that uses the library.
+*/
+#include "corgi/config.h"
+#include "corgi.h"
+#include "corgi/private.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define USE_X86_KERNELS
+#   include <immintrin.h>
+#endif
+
+typedef CorgiChar* (*Kernel)(CorgiChar*, CorgiChar*, CorgiChar, CorgiChar, CorgiChar, Bool);
+typedef CorgiChar* (*AsciiKernel)(CorgiChar*, CorgiChar*, const unsigned char*, Bool);
+
+#define IS_ONE_OF(ch, c1, c2, c3) \
+    (((ch) == (c1)) || ((ch) == (c2)) || ((ch) == (c3)))
+/* the byte of the low nibble has the bit of the high nibble */
+#define IS_IN_TABLE(table, ch) (((table)[(ch) & 15] >> ((ch) >> 4)) & 1)
+
+static CorgiChar*
+find_scalar(CorgiChar* ptr, CorgiChar* end, CorgiChar c1, CorgiChar c2, CorgiChar c3, Bool found)
+{
+    while ((ptr < end) && (IS_ONE_OF(*ptr, c1, c2, c3) != found)) {
+        ptr++;
+    }
+    return ptr;
+}
+
+static CorgiChar*
+find_ascii_scalar(CorgiChar* ptr, CorgiChar* end, const unsigned char* table, Bool found)
+{
+    while ((ptr < end) && (*ptr < 128) && (IS_IN_TABLE(table, *ptr) != found)) {
+        ptr++;
+    }
+    return ptr;
+}
+
+#if defined(USE_X86_KERNELS)
+__attribute__((target("sse2")))
+static CorgiChar*
+find_sse2(CorgiChar* ptr, CorgiChar* end, CorgiChar c1, CorgiChar c2, CorgiChar c3, Bool found)
+{
+    __m128i v1 = _mm_set1_epi32(c1);
+    __m128i v2 = _mm_set1_epi32(c2);
+    __m128i v3 = _mm_set1_epi32(c3);
+    /* the bits of the characters to stop at are set in the mask */
+    int flip = found ? 0 : 0xf;
+    for (; 4 <= end - ptr; ptr += 4) {
+        __m128i v = _mm_loadu_si128((__m128i*)ptr);
+        __m128i eq = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi32(v, v1), _mm_cmpeq_epi32(v, v2)),
+                _mm_cmpeq_epi32(v, v3));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(eq)) ^ flip;
+        if (mask != 0) {
+            return ptr + __builtin_ctz(mask);
+        }
+    }
+    return find_scalar(ptr, end, c1, c2, c3, found);
+}
+
+__attribute__((target("avx2")))
+static CorgiChar*
+find_avx2(CorgiChar* ptr, CorgiChar* end, CorgiChar c1, CorgiChar c2, CorgiChar c3, Bool found)
+{
+    __m256i v1 = _mm256_set1_epi32(c1);
+    __m256i v2 = _mm256_set1_epi32(c2);
+    __m256i v3 = _mm256_set1_epi32(c3);
+    int flip = found ? 0 : 0xff;
+    for (; 8 <= end - ptr; ptr += 8) {
+        __m256i v = _mm256_loadu_si256((__m256i*)ptr);
+        __m256i eq = _mm256_or_si256(
+                _mm256_or_si256(
+                    _mm256_cmpeq_epi32(v, v1), _mm256_cmpeq_epi32(v, v2)),
+                _mm256_cmpeq_epi32(v, v3));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq)) ^ flip;
+        if (mask != 0) {
+            return ptr + __builtin_ctz(mask);
+        }
+    }
+    return find_scalar(ptr, end, c1, c2, c3, found);
+}
+
+/* the bits of the high nibbles 0-7. the others are not ASCII */
+#define HIGH_NIBBLE_BITS 1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0
+
+__attribute__((target("ssse3")))
+static CorgiChar*
+find_ascii_ssse3(CorgiChar* ptr, CorgiChar* end, const unsigned char* table, Bool found)
+{
+    /* pshufb looks up the byte of the low nibble and the bit of the high
+       nibble of each character. only the lowest byte of a lane counts */
+    __m128i low_table = _mm_loadu_si128((const __m128i*)table);
+    __m128i high_table = _mm_setr_epi8(HIGH_NIBBLE_BITS);
+    __m128i nibble = _mm_set1_epi32(0x0f);
+    __m128i lowest = _mm_set1_epi32(0xff);
+    __m128i non_ascii = _mm_set1_epi32(~0x7f);
+    __m128i zero = _mm_setzero_si128();
+    int flip = found ? 0 : 0xf;
+    for (; 4 <= end - ptr; ptr += 4) {
+        __m128i v = _mm_loadu_si128((__m128i*)ptr);
+        __m128i low = _mm_shuffle_epi8(low_table, _mm_and_si128(v, nibble));
+        __m128i high = _mm_shuffle_epi8(high_table, _mm_and_si128(_mm_srli_epi32(v, 4), nibble));
+        __m128i bits = _mm_and_si128(_mm_and_si128(low, high), lowest);
+        int out = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(bits, zero)));
+        int ascii = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(v, non_ascii), zero)));
+        int mask = ((out ^ 0xf ^ flip) & ascii) | (ascii ^ 0xf);
+        if (mask != 0) {
+            return ptr + __builtin_ctz(mask);
+        }
+    }
+    return find_ascii_scalar(ptr, end, table, found);
+}
+
+__attribute__((target("avx2")))
+static CorgiChar*
+find_ascii_avx2(CorgiChar* ptr, CorgiChar* end, const unsigned char* table, Bool found)
+{
+    /* vpshufb looks up in each 128 bit half, so the tables are doubled */
+    __m256i low_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)table));
+    __m256i high_table = _mm256_setr_epi8(HIGH_NIBBLE_BITS, HIGH_NIBBLE_BITS);
+    __m256i nibble = _mm256_set1_epi32(0x0f);
+    __m256i lowest = _mm256_set1_epi32(0xff);
+    __m256i non_ascii = _mm256_set1_epi32(~0x7f);
+    __m256i zero = _mm256_setzero_si256();
+    int flip = found ? 0 : 0xff;
+    for (; 8 <= end - ptr; ptr += 8) {
+        __m256i v = _mm256_loadu_si256((__m256i*)ptr);
+        __m256i low = _mm256_shuffle_epi8(low_table, _mm256_and_si256(v, nibble));
+        __m256i high = _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi32(v, 4), nibble));
+        __m256i bits = _mm256_and_si256(_mm256_and_si256(low, high), lowest);
+        int out = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(bits, zero)));
+        int ascii = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(v, non_ascii), zero)));
+        int mask = ((out ^ 0xff ^ flip) & ascii) | (ascii ^ 0xff);
+        if (mask != 0) {
+            return ptr + __builtin_ctz(mask);
+        }
+    }
+    return find_ascii_scalar(ptr, end, table, found);
+}
+#endif
+
+static CorgiChar* find_first(CorgiChar*, CorgiChar*, CorgiChar, CorgiChar, CorgiChar, Bool);
+static CorgiChar* find_ascii_first(CorgiChar*, CorgiChar*, const unsigned char*, Bool);
+
+static Kernel kernel = find_first;
+static AsciiKernel ascii_kernel = find_ascii_first;
+
+static void
+choose_kernels()
+{
+    /* threads may choose at once. the stores and the loads are atomic, and
+       relaxed is enough because a kernel reads no data which is set up here */
+    Kernel k = find_scalar;
+    AsciiKernel ascii_k = find_ascii_scalar;
+#if defined(USE_X86_KERNELS)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        k = find_avx2;
+        ascii_k = find_ascii_avx2;
+    }
+    else {
+        if (__builtin_cpu_supports("sse2")) {
+            k = find_sse2;
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+            ascii_k = find_ascii_ssse3;
+        }
+    }
+#endif
+    __atomic_store_n(&kernel, k, __ATOMIC_RELAXED);
+    __atomic_store_n(&ascii_kernel, ascii_k, __ATOMIC_RELAXED);
+}
+
+static Kernel
+load_kernel()
+{
+    return __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+}
+
+static AsciiKernel
+load_ascii_kernel()
+{
+    return __atomic_load_n(&ascii_kernel, __ATOMIC_RELAXED);
+}
+
+static CorgiChar*
+find_first(CorgiChar* ptr, CorgiChar* end, CorgiChar c1, CorgiChar c2, CorgiChar c3, Bool found)
+{
+    choose_kernels();
+    return load_kernel()(ptr, end, c1, c2, c3, found);
+}
+
+static CorgiChar*
+find_ascii_first(CorgiChar* ptr, CorgiChar* end, const unsigned char* table, Bool found)
+{
+    choose_kernels();
+    return load_ascii_kernel()(ptr, end, table, found);
+}
+
+CorgiChar*
+corgi_find_char(CorgiChar* ptr, CorgiChar* end, CorgiChar c)
+{
+    return load_kernel()(ptr, end, c, c, c, TRUE);
+}
+
+CorgiChar*
+corgi_skip_char(CorgiChar* ptr, CorgiChar* end, CorgiChar c)
+{
+    return load_kernel()(ptr, end, c, c, c, FALSE);
+}
+
+CorgiChar*
+corgi_find_chars(CorgiChar* ptr, CorgiChar* end, CorgiChar* chars, CorgiUInt size)
+{
+    /* size must be 1, 2 or 3 */
+    CorgiChar c2 = 1 < size ? chars[1] : chars[0];
+    CorgiChar c3 = 2 < size ? chars[2] : c2;
+    return load_kernel()(ptr, end, chars[0], c2, c3, TRUE);
+}
+
+CorgiChar*
+corgi_find_ascii(CorgiChar* ptr, CorgiChar* end, const unsigned char* table)
+{
+    return load_ascii_kernel()(ptr, end, table, TRUE);
+}
+
+CorgiChar*
+corgi_skip_ascii(CorgiChar* ptr, CorgiChar* end, const unsigned char* table)
+{
+    return load_ascii_kernel()(ptr, end, table, FALSE);
+}
+
+/**
+ * vim: tabstop=4 shiftwidth=4 expandtab softtabstop=4
+ */
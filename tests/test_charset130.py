@@ -0,0 +1,15 @@
+# -*- coding: utf-8 -*-
+
+from os import environ
+from subprocess import PIPE, Popen
+from sys import exit
+
+args = [environ["CORGI"], "search", "[а-яё]+", "corgi корги"]
+proc = Popen(args, stdout=PIPE)
+stdout = proc.stdout.read().decode("UTF-8")
+proc.wait()
+if stdout != "корги":
+    exit(1)
+exit(0)
+
+# vim: tabstop=4 shiftwidth=4 expandtab softtabstop=4
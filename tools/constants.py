@@ -32,9 +32,11 @@ SUCCESS = "success"
 
 ANY = "any"
 ANY_ALL = "any_all"
+ASCII_BITMAP = "ascii_bitmap"
 ASSERT = "assert"
 ASSERT_NOT = "assert_not"
 AT = "at"
+ATOMIC_GROUP = "atomic_group"
 BIGCHARSET = "bigcharset"
 BRANCH = "branch"
 CALL = "call"
@@ -49,6 +51,8 @@ INFO = "info"
 JUMP = "jump"
 LITERAL = "literal"
 LITERAL_IGNORE = "literal_ignore"
+LITERAL_STRING = "literal_string"
+LITERAL_STRING_IGNORE = "literal_string_ignore"
 MARK = "mark"
 MAX_REPEAT = "max_repeat"
 MAX_UNTIL = "max_until"
@@ -57,6 +61,8 @@ MIN_UNTIL = "min_until"
 NEGATE = "negate"
 NOT_LITERAL = "not_literal"
 NOT_LITERAL_IGNORE = "not_literal_ignore"
+POSSESSIVE_REPEAT = "possessive_repeat"
+POSSESSIVE_REPEAT_ONE = "possessive_repeat_one"
 RANGE = "range"
 REPEAT = "repeat"
 REPEAT_ONE = "repeat_one"
@@ -123,7 +129,11 @@ OPCODES = [
     REPEAT,
     REPEAT_ONE,
     SUBPATTERN,
-    MIN_REPEAT_ONE
+    MIN_REPEAT_ONE,
+    LITERAL_STRING, LITERAL_STRING_IGNORE,
+    ATOMIC_GROUP,
+    POSSESSIVE_REPEAT, POSSESSIVE_REPEAT_ONE,
+    ASCII_BITMAP
 
 ]
 
@@ -214,6 +224,8 @@ SRE_FLAG_ASCII = 256 # use ascii "locale"
 SRE_INFO_PREFIX = 1 # has prefix
 SRE_INFO_LITERAL = 2 # entire pattern is literal (given by prefix)
 SRE_INFO_CHARSET = 4 # pattern starts with character from given set
+SRE_INFO_IGNORE = 8 # prefix and charset are in lower case
+SRE_INFO_SKIP = 16 # prefix has a skip table for a bad character
 
 if __name__ == "__main__":
     def dump(fp, d, prefix):
@@ -255,6 +267,8 @@ if __name__ == "__main__":
         fp.write("#define SRE_INFO_PREFIX %d\n" % SRE_INFO_PREFIX)
         fp.write("#define SRE_INFO_LITERAL %d\n" % SRE_INFO_LITERAL)
         fp.write("#define SRE_INFO_CHARSET %d\n" % SRE_INFO_CHARSET)
+        fp.write("#define SRE_INFO_IGNORE %d\n" % SRE_INFO_IGNORE)
+        fp.write("#define SRE_INFO_SKIP %d\n" % SRE_INFO_SKIP)
         fp.write("""\
 #endif
 """)